@@ -0,0 +1,145 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <stdlib.h>
+
+#include "adapt.h"
+#include "cfg.h"
+
+#include <lucid/log.h>
+
+/* changes below these floors never count as a change: 0.1 in the kernel's
+ * fixed point load average, two threads and one KiB/s of traffic */
+#define ADAPT_FLOOR_LOAD     205
+#define ADAPT_FLOOR_THREADS  2
+#define ADAPT_FLOOR_TRAFFIC  1024
+
+static int adaptive  = 0;
+static int threshold = 0;
+static int maxinterval = STEP;
+
+int adapt_init(void)
+{
+	LOG_TRACEME
+
+	adaptive  = cfg_getbool(cfg, "adaptive");
+	threshold = cfg_getint(cfg, "adaptive_threshold");
+
+	/* updates must stay closer together than the heartbeat, otherwise
+	 * rrd_update records the gap as unknown instead of spreading the next
+	 * value back over it */
+	maxinterval = ((atoi(HEARTBEAT) - 1) / STEP) * STEP;
+
+	if (maxinterval < STEP)
+		maxinterval = STEP;
+
+	if (threshold < 0)
+		threshold = 0;
+
+	return 0;
+}
+
+static
+uint64_t adapt_rate(int g, const sample_t *s)
+{
+	uint64_t cur = 0, prev = GUESTS.bytes[g];
+	time_t prevtime = GUESTS.cacct_time[g];
+	int i;
+
+	for (i = 0; i < CACCT_NR; i++)
+		cur += s->cacct[i].recvb + s->cacct[i].sendb;
+
+	if (cur < prev || s->cacct_time <= prevtime)
+		return 0;
+
+	return (cur - prev) / (s->cacct_time - prevtime);
+}
+
+static
+int adapt_differs(uint64_t a, uint64_t b, uint64_t floor)
+{
+	uint64_t delta = a > b ? a - b : b - a;
+	uint64_t base  = a > b ? a : b;
+
+	if (delta < floor)
+		return 0;
+
+	return delta * 100 > base * threshold;
+}
+
+static
+int adapt_changed(int g, const sample_t *s)
+{
+	const uint64_t *cvirt = GUESTS.cvirt[g];
+
+	return adapt_differs(s->loadavg[LOADAVG_1MIN],
+	                     GUESTS.load1[g], ADAPT_FLOOR_LOAD) ||
+	       adapt_differs(s->cvirt[CVIRT_TOTAL],
+	                     cvirt[CVIRT_TOTAL], ADAPT_FLOOR_THREADS) ||
+	       adapt_differs(s->cvirt[CVIRT_RUNNING],
+	                     cvirt[CVIRT_RUNNING], ADAPT_FLOOR_THREADS) ||
+	       adapt_differs(s->cvirt[CVIRT_UNINTR],
+	                     cvirt[CVIRT_UNINTR], ADAPT_FLOOR_THREADS) ||
+	       adapt_differs(adapt_rate(g, s),
+	                     GUESTS.traffic[g], ADAPT_FLOOR_TRAFFIC);
+}
+
+/* decide whether a guest gets a full sample this cycle: busy guests are
+ * sampled every STEP, stable guests back off up to maxinterval */
+int adapt_due(int g, const sample_t *s)
+{
+	LOG_TRACEME
+
+	int *interval = &GUESTS.interval[g];
+
+	if (!adaptive || !GUESTS.valid[g])
+		return 1;
+
+	if (adapt_changed(g, s)) {
+		*interval = STEP;
+		return 1;
+	}
+
+	if (s->cvirt_time - GUESTS.written[g] >= *interval) {
+		*interval *= 2;
+
+		if (*interval > maxinterval)
+			*interval = maxinterval;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+void adapt_written(int g, const sample_t *s)
+{
+	LOG_TRACEME
+
+	GUESTS.traffic[g] = GUESTS.valid[g] ? adapt_rate(g, s) : 0;
+	GUESTS.written[g] = s->cvirt_time;
+
+	if (GUESTS.interval[g] < STEP)
+		GUESTS.interval[g] = STEP;
+}
+
+/* longest time a guest may go without being written */
+int adapt_maxinterval(void)
+{
+	LOG_TRACEME
+
+	return adaptive ? maxinterval : STEP;
+}
@@ -0,0 +1,406 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "archive.h"
+#include "cfg.h"
+#include "datadir.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+#include <lucid/str.h>
+
+/* not exported by glibc */
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_CLASS_SHIFT  13
+
+/* the datadir walker skips dot entries, so nothing in here is seen as a
+ * guest by vstatd, vstatd-graph or vstatd-export */
+#define ARCHIVE_DIR ".archive"
+
+/* a run that found nothing to do or failed is repeated after this many
+ * seconds */
+#define ARCHIVE_INTERVAL 3600
+
+/* exit code of a run that stopped at archive_batch with work left */
+#define ARCHIVE_MORE 2
+
+static time_t after  = 0;
+static int    batch  = 0;
+static int    remove_only = 0;
+
+static pid_t  child = -1;
+static time_t next  = 0;
+
+int archive_init(void)
+{
+	LOG_TRACEME
+
+	const char *policy = cfg_getstr(cfg, "archive_policy");
+
+	after = (time_t) cfg_getint(cfg, "archive_days") * 86400;
+	batch = cfg_getint(cfg, "archive_batch");
+
+	if (batch < 1)
+		batch = 1;
+
+	if (policy && strcmp(policy, "delete") == 0)
+		remove_only = 1;
+
+	else if (!policy || strcmp(policy, "archive") == 0)
+		remove_only = 0;
+
+	else {
+		log_error("Unknown archive_policy '%s'", policy);
+		after = 0;
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static
+int archive_rm(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	if (remove(path) == -1)
+		log_perror("remove(%s)", path);
+
+	return 0;
+}
+
+/* run tar in the foreground, it already knows how to store a directory
+ * tree compressed and restore it with permissions and times intact */
+static
+int archive_tar(char *const argv[])
+{
+	LOG_TRACEME
+
+	int status;
+	pid_t pid;
+
+	switch ((pid = fork())) {
+	case -1:
+		log_perror("fork");
+		return -1;
+
+	case 0:
+#ifdef SYS_close_range
+		/* nothing the daemon has open is any of tar's business */
+		syscall(SYS_close_range, 3, ~0U, 0);
+#endif
+		execvp(argv[0], argv);
+		_exit(127);
+
+	default:
+		while (waitpid(pid, &status, 0) == -1)
+			if (errno != EINTR)
+				return -1;
+
+		break;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		log_error("tar failed for %s", argv[4]);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* time of the last update of any rrd of a guest, that of its directory
+ * if it has none yet */
+static
+time_t archive_mtime(const char *datadir, const char *guest)
+{
+	LOG_TRACEME
+
+	char **rrds, *dir = NULL;
+	int i, n = datadir_rrds(datadir, guest, &rrds);
+	time_t newest = 0;
+	struct stat sb;
+
+	for (i = 0; i < n; i++) {
+		char *path = NULL;
+		struct stat sb;
+
+		asprintf(&path, "%s/%s/%s", datadir, guest, rrds[i]);
+
+		if (stat(path, &sb) == 0 && sb.st_mtime > newest)
+			newest = sb.st_mtime;
+
+		mem_free(path);
+	}
+
+	if (n > 0)
+		datadir_free(rrds, n);
+
+	if (newest > 0)
+		return newest;
+
+	asprintf(&dir, "%s/%s", datadir, guest);
+
+	if (stat(dir, &sb) == 0)
+		newest = sb.st_mtime;
+
+	mem_free(dir);
+
+	/* a guest that cannot be looked at is left alone */
+	return newest > 0 ? newest : time(NULL);
+}
+
+/* pack one staged guest, <work>/<guest>, into <work>.tar.gz and drop
+ * the staging directory; a run interrupted half way repeats this */
+static
+int archive_finish(const char *workdir, const char *work)
+{
+	LOG_TRACEME
+
+	char *path = NULL, *tmp = NULL, *tarfile = NULL, **guests = NULL;
+	int n, rc = 0;
+
+	asprintf(&path, "%s/%s", workdir, work);
+
+	if (!remove_only) {
+		if ((n = datadir_guests(path, &guests)) != 1) {
+			log_error("Unexpected content in %s", path);
+			datadir_free(guests, n > 0 ? n : 0);
+			mem_free(path);
+			return -1;
+		}
+
+		/* staging directories are named <guest>-<time>.d */
+		asprintf(&tarfile, "%s/%.*s.tar.gz", workdir,
+		         (int) (str_len(work) - 2), work);
+		asprintf(&tmp, "%s.tmp", tarfile);
+
+		char *argv[] = { "tar", "-C", path, "-czf", tmp, guests[0], NULL };
+
+		if (archive_tar(argv) == -1 || rename(tmp, tarfile) == -1) {
+			unlink(tmp);
+			rc = -1;
+		}
+
+		else
+			log_info("Archived guest %s to %s", guests[0], tarfile);
+
+		datadir_free(guests, n);
+		mem_free(tarfile);
+		mem_free(tmp);
+	}
+
+	if (rc == 0)
+		nftw(path, archive_rm, 16, FTW_DEPTH|FTW_PHYS);
+
+	mem_free(path);
+	return rc;
+}
+
+/* take a departed guest out of the datadir in one rename, so a guest that
+ * comes back in the meantime just starts with new files */
+static
+int archive_guest(const char *datadir, const char *workdir,
+                  const char *guest, time_t mtime)
+{
+	LOG_TRACEME
+
+	char *src = NULL, *work = NULL, *dst = NULL;
+	int rc = -1;
+
+	asprintf(&src,  "%s/%s", datadir, guest);
+	asprintf(&work, "%s-%ld.d", guest, (long) mtime);
+	asprintf(&dst,  "%s/%s/%s", workdir, work, guest);
+
+	if (mkdirnamep(dst, 0700) == -1)
+		log_perror("mkdirnamep(%s)", dst);
+
+	else if (rename(src, dst) == -1)
+		log_perror("rename(%s)", src);
+
+	else {
+		if (remove_only)
+			log_info("Deleting guest %s, not updated since %ld",
+			         guest, (long) mtime);
+
+		rc = archive_finish(workdir, work);
+	}
+
+	mem_free(src);
+	mem_free(work);
+	mem_free(dst);
+
+	return rc;
+}
+
+/* the maintenance task: finish interrupted work, then archive up to
+ * archive_batch guests not updated for archive_days */
+static
+int archive_child(time_t now)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *workdir = NULL, **guests = NULL, **work = NULL;
+	int i, n, done = 0, failed = 0;
+
+	/* everything here may wait for anything else */
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+	        IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+	nice(19);
+
+	asprintf(&workdir, "%s/" ARCHIVE_DIR, datadir);
+
+	if (mkdir(workdir, 0700) == -1 && errno != EEXIST) {
+		log_perror("mkdir(%s)", workdir);
+		return EXIT_FAILURE;
+	}
+
+	/* staging directories left by an interrupted run */
+	if ((n = datadir_guests(workdir, &work)) > 0) {
+		for (i = 0; i < n && done < batch; i++) {
+			if (archive_finish(workdir, work[i]) == 0)
+				done++;
+			else
+				failed++;
+		}
+
+		datadir_free(work, n);
+	}
+
+	if ((n = datadir_guests(datadir, &guests)) == -1)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < n && done < batch; i++) {
+		time_t mtime = archive_mtime(datadir, guests[i]);
+
+		if (now - mtime < after)
+			continue;
+
+		if (archive_guest(datadir, workdir, guests[i], mtime) == 0)
+			done++;
+		else
+			failed++;
+	}
+
+	datadir_free(guests, n);
+	mem_free(workdir);
+
+	/* failures are retried, but not before the next regular run */
+	if (failed > 0)
+		return EXIT_FAILURE;
+
+	return done < batch ? EXIT_SUCCESS : ARCHIVE_MORE;
+}
+
+/* called once per cycle: starts the maintenance task when it is due and
+ * reaps it when it is done, collection never waits for it */
+void archive_run(time_t now)
+{
+	LOG_TRACEME
+
+	int status;
+
+	if (child != -1) {
+		if (waitpid(child, &status, WNOHANG) == 0)
+			return;
+
+		child = -1;
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status) == EXIT_FAILURE)
+			log_warn("Archive maintenance failed, retrying in %d seconds",
+			         ARCHIVE_INTERVAL);
+
+		/* more work left, continue in the next cycle */
+		next = now + (WIFEXITED(status) && WEXITSTATUS(status) == ARCHIVE_MORE ?
+		              0 : ARCHIVE_INTERVAL);
+	}
+
+	if (after < 1 || now < next)
+		return;
+
+	switch ((child = fork())) {
+	case -1:
+		log_perror("fork");
+		next = now + ARCHIVE_INTERVAL;
+		break;
+
+	case 0:
+		exit(archive_child(now));
+
+	default:
+		break;
+	}
+}
+
+/* unpack an archive made by the maintenance task back into the datadir */
+int archive_restore(const char *name)
+{
+	LOG_TRACEME
+
+	char *datadir = cfg_getstr(cfg, "datadir");
+	const char *base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+	char *path = NULL, *guest = str_dup(base), *dir = NULL, *p;
+	int rc = -1;
+
+	if (strchr(name, '/'))
+		path = str_dup(name);
+	else
+		asprintf(&path, "%s/" ARCHIVE_DIR "/%s", datadir, name);
+
+	/* archives are named <guest>-<time>.tar.gz */
+	if (!(p = strrchr(guest, '-')) || str_len(p) <= 7 ||
+	    !str_equal(p + str_len(p) - 7, ".tar.gz")) {
+		log_error("%s is not a guest archive", name);
+		goto out;
+	}
+
+	*p = '\0';
+	asprintf(&dir, "%s/%s", datadir, guest);
+
+	if (isdir(dir)) {
+		log_error("Guest %s already has data in %s", guest, dir);
+		goto out;
+	}
+
+	/* -m gives the files the current time, otherwise the next run would
+	 * archive the guest again right away */
+	char *argv[] = { "tar", "-C", datadir, "-xmzf", path, guest, NULL };
+
+	if (archive_tar(argv) == 0 && unlink(path) == 0) {
+		log_info("Restored guest %s from %s", guest, path);
+		rc = 0;
+	}
+
+out:
+	mem_free(path);
+	mem_free(guest);
+	mem_free(dir);
+	return rc;
+}
@@ -0,0 +1,805 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ftw.h>
+#include <limits.h>
+#include <malloc.h>
+#include <syslog.h>
+#include <sys/stat.h>
+
+#include "cfg.h"
+#include "cgroup.h"
+#include "guest.h"
+#include "procfs.h"
+#include "rate.h"
+#include "vrrd.h"
+
+#include <lucid/log.h>
+#include <lucid/mem.h>
+
+/* benchmarks of the storage path and a soak mode for memory growth, every
+ * result is one JSON object per line on stdout */
+
+static cfg_opt_t BENCH_OPTS[] = {
+	CFG_STR("datadir", NULL,  CFGF_NONE),
+	CFG_STR("schema",  "raw", CFGF_NONE),
+	CFG_BOOL("procfs", cfg_true, CFGF_NONE),
+	CFG_STR("procdir", NULL,  CFGF_NONE),
+	CFG_STR("backend", "vserver", CFGF_NONE),
+	CFG_STR("cgroup_root", NULL, CFGF_NONE),
+	CFG_STR_LIST("cgroups", "{machine.slice}", CFGF_NONE),
+	CFG_END()
+};
+
+cfg_t *cfg;
+
+static const char *tag = "";
+static int failed = 0;
+
+#ifdef __GLIBC__
+/* count every allocation of the process, including librrd and lucid */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+static unsigned long allocs = 0, frees = 0;
+
+void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (!ptr)
+		allocs++;
+
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if (ptr)
+		frees++;
+
+	__libc_free(ptr);
+}
+#else
+static unsigned long allocs = 0, frees = 0;
+#endif
+
+static inline
+void usage(int rc)
+{
+	printf("Usage: vstatd-bench [<opts>]\n"
+	       "\n"
+	       "Available options:\n"
+	       "   -D <dir>      data directory (default: temporary directory in /dev/shm)\n"
+	       "   -n <n>        iterations of the micro benchmarks (default: 10000)\n"
+	       "   -k <n>        synthetic guests per cycle (default: 10)\n"
+	       "   -c <n>        cycles of the full cycle benchmark (default: 3)\n"
+	       "   -s <n>        soak for <n> cycles (default: 0)\n"
+	       "   -t <tag>      tag added to every result, e.g. a commit id\n");
+	exit(rc);
+}
+
+static
+uint64_t bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+long bench_rss(void)
+{
+	long size, rss = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (fp) {
+		if (fscanf(fp, "%ld %ld", &size, &rss) != 2)
+			rss = 0;
+
+		fclose(fp);
+	}
+
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static
+size_t bench_heap(void)
+{
+#if defined(HAVE_MALLINFO2)
+	return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+	return mallinfo().uordblks;
+#else
+	return 0;
+#endif
+}
+
+static
+void bench_result(const char *name, const char *extra, unsigned long ops, uint64_t ns)
+{
+	printf("{\"tag\":\"%s\",\"bench\":\"%s\",%s\"ops\":%lu,\"ns_per_op\":%.1f}\n",
+	       tag, name, extra, ops, ops ? (double) ns / ops : 0.0);
+	fflush(stdout);
+}
+
+/* deterministic counters that grow with every cycle */
+static
+void bench_sample(sample_t *s, int guest, int cycle, time_t t)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+
+	s->id = guest;
+	snprintf(s->name, SAMPLE_NAMELEN, "bench%04d", guest);
+
+	s->cacct_time = s->cvirt_time = s->limit_time = s->loadavg_time = t;
+	s->cgroup_time = s->sched_time = s->dlimit_time = s->burst_time = t;
+
+	for (i = 0; i < CACCT_NR; i++) {
+		s->cacct[i].recvp = (uint64_t) cycle * (i + 1) * 10;
+		s->cacct[i].recvb = (uint64_t) cycle * (i + 1) * 15000;
+		s->cacct[i].sendp = (uint64_t) cycle * (i + 1) * 8;
+		s->cacct[i].sendb = (uint64_t) cycle * (i + 1) * 9000;
+	}
+
+	for (i = 0; i < CVIRT_NR; i++)
+		s->cvirt[i] = guest + i + cycle % 7;
+
+	for (i = 0; i < LIMIT_NR; i++) {
+		s->limit[i].cur = 100 + (cycle + i) % 50;
+		s->limit[i].min = 100;
+		s->limit[i].max = 150;
+	}
+
+	for (i = 0; i < LOADAVG_NR; i++)
+		s->loadavg[i] = (cycle * 37 + i) % 4096;
+
+	s->dlimit.space_used  = 1048576 + cycle;
+	s->dlimit.inodes_used = 65536 + cycle;
+
+	s->sched.user   = (uint64_t) cycle * 300;
+	s->sched.system = (uint64_t) cycle * 100;
+	s->sched.tokens = 500 - cycle % 500;
+
+	s->cpu.user   = (uint64_t) cycle * 1000;
+	s->cpu.system = (uint64_t) cycle * 500;
+	s->io.rbytes  = (uint64_t) cycle * 4096;
+	s->io.wbytes  = (uint64_t) cycle * 8192;
+
+	for (i = 0; i < BURST_NR; i++) {
+		s->burst[i].min = cycle % 3;
+		s->burst[i].max = cycle % 3 + 8 * (i + 1);
+		s->burst[i].p99 = cycle % 3 + 7 * (i + 1);
+	}
+}
+
+static
+void bench_align(unsigned long n)
+{
+	time_t t = time(NULL), sink = 0;
+	unsigned long i;
+	uint64_t start = bench_ns();
+
+	for (i = 0; i < n; i++)
+		sink += vrrd_align_time(t + i);
+
+	bench_result("align_time", "", n, bench_ns() - start);
+
+	if (sink == 0)
+		failed++;
+}
+
+/* argument formatting of every family, without calling librrd */
+static
+void bench_format(unsigned long n, time_t base)
+{
+	static struct {
+		const char *name;
+		int (*update)(sample_t *s);
+	} FAMILIES[] = {
+		{ "format_cacct",   cacct_rrd_update },
+		{ "format_cvirt",   cvirt_rrd_update },
+		{ "format_limit",   limit_rrd_update },
+		{ "format_loadavg", loadavg_rrd_update },
+		{ "format_sched",   sched_rrd_update },
+		{ "format_dlimit",  dlimit_rrd_update },
+		{ "format_cgroup",  cgroup_rrd_update },
+		{ "format_burst",   burst_rrd_update },
+		{ NULL, NULL }
+	};
+
+	sample_t s;
+	unsigned long i;
+	int f;
+
+	bench_sample(&s, 8000, 1, base);
+
+	if (vrrd_store(&s) == -1)
+		failed++;
+
+	vrrd_dryrun = 1;
+
+	for (f = 0; FAMILIES[f].name; f++) {
+		uint64_t start = bench_ns();
+
+		for (i = 0; i < n; i++)
+			FAMILIES[f].update(&s);
+
+		bench_result(FAMILIES[f].name, "", n, bench_ns() - start);
+	}
+
+	vrrd_dryrun = 0;
+}
+
+/* cost of a single file update for every schema, measured on net_* */
+static
+void bench_update(unsigned long n, time_t base)
+{
+	const char *SCHEMAS[] = { "raw", "rate", NULL };
+	char extra[64];
+	unsigned long i;
+	int k;
+
+	for (k = 0; SCHEMAS[k]; k++) {
+		sample_t s;
+
+		cfg_setstr(cfg, "schema", SCHEMAS[k]);
+
+		bench_sample(&s, 9000 + k, 0, base);
+
+		if (cacct_rrd_check(&s) == -1) {
+			failed++;
+			continue;
+		}
+
+		uint64_t start = bench_ns();
+
+		for (i = 0; i < n; i++) {
+			bench_sample(&s, 9000 + k, i + 1, base + (i + 1) * STEP);
+
+			if (cacct_rrd_update(&s) == -1)
+				failed++;
+		}
+
+		snprintf(extra, sizeof(extra), "\"schema\":\"%s\",", SCHEMAS[k]);
+		bench_result("rrd_update", extra, n * CACCT_NR, bench_ns() - start);
+	}
+
+	cfg_setstr(cfg, "schema", "raw");
+}
+
+static
+int bench_write(const char *dir, const char *file, const char *buf)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+	if (!(fp = fopen(path, "w")))
+		return -1;
+
+	fputs(buf, fp);
+	return fclose(fp);
+}
+
+/* a fixture procdir in the format of /proc/virtual/<xid>, holding the
+ * counters of bench_sample with a fixed load average */
+static
+int bench_procdir(const char *procdir, sample_t *s)
+{
+	static const char *FAMILIES[CACCT_NR] = {
+		"UNSPEC", "UNIX", "INET", "INET6", "PACKET", "OTHER",
+	};
+
+	static const char *LIMITS[LIMIT_NR] = {
+		"VM", "LOCKS", "VML", "MSGQ", "FILES", "PROC", "RSS", "ANON",
+		"DENT", "RMAP", "SEMS", "SOCK", "OFD", "SEMA", "SHM",
+	};
+
+	char dir[PATH_MAX], buf[2048];
+	int i, len;
+
+	snprintf(dir, sizeof(dir), "%s/%" PRIu64, procdir, s->id);
+
+	if (mkdir(dir, 0755) == -1)
+		return -1;
+
+	for (i = 0, len = 0; i < CACCT_NR; i++)
+		len += snprintf(buf + len, sizeof(buf) - len,
+		                "%s:\t%" PRIu64 "/%" PRIu64 "\t%" PRIu64 "/%" PRIu64
+		                "\t%" PRIu64 "/%" PRIu64 "\n", FAMILIES[i],
+		                s->cacct[i].recvp, s->cacct[i].recvb,
+		                s->cacct[i].sendp, s->cacct[i].sendb,
+		                s->cacct[i].failp, s->cacct[i].failb);
+
+	if (bench_write(dir, "cacct", buf) == -1)
+		return -1;
+
+	snprintf(buf, sizeof(buf),
+	         "nr_threads:\t\t%" PRIu64 "\n"
+	         "nr_running:\t\t%" PRIu64 "\n"
+	         "nr_uninterruptible:\t%" PRIu64 "\n"
+	         "nr_onhold:\t\t%" PRIu64 "\n"
+	         "loadavg:\t\t1.50 0.75 0.25\n",
+	         s->cvirt[CVIRT_TOTAL], s->cvirt[CVIRT_RUNNING],
+	         s->cvirt[CVIRT_UNINTR], s->cvirt[CVIRT_ONHOLD]);
+
+	if (bench_write(dir, "cvirt", buf) == -1)
+		return -1;
+
+	for (i = 0, len = 0; i < LIMIT_NR; i++)
+		len += snprintf(buf + len, sizeof(buf) - len,
+		                "%s:\t%" PRIu64 "\t%" PRIu64 "/%" PRIu64 "\t-1\t0\n",
+		                LIMITS[i], s->limit[i].cur,
+		                s->limit[i].min, s->limit[i].max);
+
+	if (bench_write(dir, "limit", buf) == -1)
+		return -1;
+
+	/* two cpus sharing the counters */
+	snprintf(buf, sizeof(buf),
+	         "cpu 0: %" PRIu64 " %" PRIu64 " 0 0 0 R- %" PRIu64 " 0 500\n"
+	         "cpu 1: %" PRIu64 " %" PRIu64 " 0 0 0 R- %" PRIu64 " 0 500\n",
+	         s->sched.user / 2, s->sched.system / 2, s->sched.tokens / 2,
+	         s->sched.user - s->sched.user / 2,
+	         s->sched.system - s->sched.system / 2,
+	         s->sched.tokens - s->sched.tokens / 2);
+
+	return bench_write(dir, "sched", buf);
+}
+
+/* the batched procfs reader against a fixture tree, checking every
+ * counter it parsed */
+static
+void bench_procfs(int guests, const char *datadir, time_t base)
+{
+	char procdir[PATH_MAX], extra[64];
+	sample_t *batch, want;
+	int g, i;
+
+	snprintf(procdir, sizeof(procdir), "%s/.procfs", datadir);
+
+	if (mkdir(procdir, 0755) == -1 ||
+	    !(batch = mem_alloc(guests * sizeof(sample_t)))) {
+		failed++;
+		return;
+	}
+
+	for (g = 0; g < guests; g++) {
+		bench_sample(&batch[g], 7000 + g, 1, base);
+
+		if (bench_procdir(procdir, &batch[g]) == -1)
+			failed++;
+
+		/* only the id is known before the fetch */
+		memset(&batch[g], 0, sizeof(sample_t));
+		batch[g].id = 7000 + g;
+	}
+
+	cfg_setstr(cfg, "procdir", procdir);
+
+	if (procfs_init() == -1) {
+		failed++;
+		mem_free(batch);
+		return;
+	}
+
+	uint64_t start = bench_ns();
+	procfs_fetch(batch, guests);
+	uint64_t ns = bench_ns() - start;
+
+	for (g = 0; g < guests; g++) {
+		sample_t *s = &batch[g];
+
+		bench_sample(&want, 7000 + g, 1, base);
+
+		if (!procfs_complete(s) || !s->sched_time)
+			failed++;
+
+		for (i = 0; i < CACCT_NR; i++)
+			if (memcmp(&s->cacct[i], &want.cacct[i], sizeof(want.cacct[i])))
+				failed++;
+
+		for (i = 0; i < LIMIT_NR; i++)
+			if (s->limit[i].cur != want.limit[i].cur ||
+			    s->limit[i].min != want.limit[i].min ||
+			    s->limit[i].max != want.limit[i].max)
+				failed++;
+
+		if (memcmp(s->cvirt, want.cvirt, sizeof(want.cvirt)) ||
+		    s->loadavg[LOADAVG_1MIN]  != 3072 ||
+		    s->loadavg[LOADAVG_5MIN]  != 1536 ||
+		    s->loadavg[LOADAVG_15MIN] != 512)
+			failed++;
+
+		if (s->sched.user   != want.sched.user ||
+		    s->sched.system != want.sched.system ||
+		    s->sched.tokens != want.sched.tokens)
+			failed++;
+	}
+
+	mem_free(batch);
+
+	snprintf(extra, sizeof(extra), "\"guests\":%d,", guests);
+	bench_result("procfs_fetch", extra, guests, ns);
+}
+
+static int cgroup_seen = 0;
+
+static
+int bench_exists(const sample_t *s, const char *db)
+{
+	char path[PATH_MAX];
+	struct stat sb;
+
+	snprintf(path, sizeof(path), "%s/%s/%s.rrd",
+	         cfg_getstr(cfg, "datadir"), s->name, db);
+
+	return stat(path, &sb) == 0;
+}
+
+/* every fourth group of the cgroup fixture has neither the memory nor the
+ * pids controller enabled */
+#define BENCH_CG_PARTIAL(g) ((g) % 4 == 3)
+
+/* a guest of the cgroup fixture: only what cgroups have an equivalent for
+ * is known and only those files are written */
+static
+void bench_cgroup_sample(sample_t *s)
+{
+	int g, i;
+
+	cgroup_seen++;
+
+	if (sscanf(s->name, "bench-cg%d", &g) != 1) {
+		failed++;
+		return;
+	}
+
+	for (i = 0; i < CVIRT_NR; i++)
+		if (i != CVIRT_TOTAL && s->cvirt[i] != SAMPLE_UNKNOWN)
+			failed++;
+
+	for (i = 0; i < LIMIT_NR; i++)
+		if (i != LIMIT_RSS && i != LIMIT_NPROC &&
+		    s->limit[i].cur != SAMPLE_UNKNOWN)
+			failed++;
+
+	if (s->cpu.user != 6 || s->cpu.system != 3 ||
+	    s->io.rbytes != 4096 || s->io.wios != 2)
+		failed++;
+
+	/* without the memory and pids controllers nothing is known about
+	 * threads, memory and processes */
+	if (BENCH_CG_PARTIAL(g)) {
+		if (s->cvirt[CVIRT_TOTAL] != SAMPLE_UNKNOWN ||
+		    s->limit[LIMIT_RSS].cur != SAMPLE_UNKNOWN ||
+		    s->limit[LIMIT_NPROC].cur != SAMPLE_UNKNOWN)
+			failed++;
+	}
+
+	else if (s->cvirt[CVIRT_TOTAL] != (uint64_t) g + 3 ||
+	         s->limit[LIMIT_RSS].cur != ((uint64_t) g + 1) * 1048576 ||
+	         s->limit[LIMIT_RSS].max != 0 ||
+	         s->limit[LIMIT_NPROC].cur != (uint64_t) g + 3 ||
+	         s->limit[LIMIT_NPROC].max != 100)
+		failed++;
+
+	if (vrrd_store(s) == -1)
+		failed++;
+
+	if (!bench_exists(s, "cg_CPU") ||
+	    bench_exists(s, "thread_RUNNING") || bench_exists(s, "mem_AS"))
+		failed++;
+
+	if (bench_exists(s, "thread_TOTAL") == BENCH_CG_PARTIAL(g) ||
+	    bench_exists(s, "mem_RSS")      == BENCH_CG_PARTIAL(g) ||
+	    bench_exists(s, "sys_NPROC")    == BENCH_CG_PARTIAL(g))
+		failed++;
+}
+
+/* the cgroup backend against a fixture tree of cgroup v2 files */
+static
+void bench_cgroup(int guests, const char *datadir)
+{
+	char root[PATH_MAX], dir[PATH_MAX], buf[64];
+	int g;
+
+	snprintf(root, sizeof(root), "%s/.cgroup", datadir);
+	snprintf(dir,  sizeof(dir),  "%s/machine.slice", root);
+
+	if (mkdir(root, 0755) == -1 || mkdir(dir, 0755) == -1) {
+		failed++;
+		return;
+	}
+
+	for (g = 0; g < guests; g++) {
+		snprintf(dir, sizeof(dir), "%s/machine.slice/bench-cg%d", root, g);
+
+		if (mkdir(dir, 0755) == -1) {
+			failed++;
+			return;
+		}
+
+		bench_write(dir, "memory.max", "max\n");
+		bench_write(dir, "pids.max", "100\n");
+
+		if (!BENCH_CG_PARTIAL(g)) {
+			snprintf(buf, sizeof(buf), "%d\n", (g + 1) * 1048576);
+			bench_write(dir, "memory.current", buf);
+
+			snprintf(buf, sizeof(buf), "%d\n", g + 3);
+			bench_write(dir, "pids.current", buf);
+		}
+
+		bench_write(dir, "cpu.stat", "usage_usec 9\nuser_usec 6\n"
+		            "system_usec 3\nthrottled_usec 0\n");
+		bench_write(dir, "io.stat", "8:0 rbytes=4096 wbytes=8192 rios=1 "
+		            "wios=2 dbytes=0 dios=0\n");
+	}
+
+	cfg_setstr(cfg, "backend", "cgroup");
+	cfg_setstr(cfg, "cgroup_root", root);
+	cgroup_init();
+
+	uint64_t start = bench_ns();
+	cgroup_walk(1, bench_cgroup_sample);
+	uint64_t ns = bench_ns() - start;
+
+	if (cgroup_seen != guests)
+		failed++;
+
+	/* closes every file again */
+	cfg_setstr(cfg, "backend", "vserver");
+	cgroup_init();
+
+	snprintf(buf, sizeof(buf), "\"guests\":%d,", guests);
+	bench_result("cgroup_cycle", buf, guests, ns);
+}
+
+/* the guest store has to hold 10,000 contexts in a few MB: every cycle
+ * one guest leaves and a new one takes over its slot */
+#define BENCH_GUESTS 10000
+
+static
+void bench_guests(int cycles, time_t base)
+{
+	char extra[128];
+	uint64_t ns = 0;
+	sample_t s;
+	int c, i, g;
+
+	for (c = 1; c <= cycles; c++) {
+		bench_sample(&s, 0, c, base + c * STEP);
+
+		uint64_t start = bench_ns();
+
+		for (i = c; i < BENCH_GUESTS + c; i++) {
+			if ((g = guest_get(10000 + i, c)) == -1) {
+				failed++;
+				break;
+			}
+
+			guest_remember(g, &s);
+		}
+
+		guest_sweep(c);
+		ns += bench_ns() - start;
+	}
+
+	size_t bytes = guest_footprint();
+
+	if (bytes > (size_t) BENCH_GUESTS * GUEST_SLOT_MAX)
+		failed++;
+
+	/* the previous counters of every guest go away once it stopped being
+	 * stored for two heartbeats */
+	for (i = 0; i < BENCH_GUESTS; i++) {
+		snprintf(s.name, SAMPLE_NAMELEN, "guest%d", i);
+
+		if (!rate_get(s.name))
+			failed++;
+	}
+
+	size_t rates = rate_footprint();
+
+	rate_sweep(time(NULL) + 3 * atoi(HEARTBEAT));
+
+	if (rate_footprint() >= rates)
+		failed++;
+
+	snprintf(extra, sizeof(extra), "\"guests\":%d,\"bytes\":%zu,"
+	         "\"bytes_per_guest\":%zu,\"rate_bytes\":%zu,",
+	         BENCH_GUESTS, bytes, bytes / BENCH_GUESTS, rates);
+
+	bench_result("guest_store", extra, (unsigned long) cycles * BENCH_GUESTS, ns);
+}
+
+/* one cycle stores every guest, the first one also creates the files */
+static
+uint64_t bench_cycle(int guests, int cycle, time_t t)
+{
+	uint64_t start = bench_ns();
+	sample_t s;
+	int g;
+
+	for (g = 0; g < guests; g++) {
+		bench_sample(&s, g, cycle, t);
+
+		if (vrrd_store(&s) == -1)
+			failed++;
+	}
+
+	return bench_ns() - start;
+}
+
+static
+void bench_cycles(int guests, int cycles, time_t base)
+{
+	char extra[64];
+	uint64_t ns = 0;
+	int c;
+
+	snprintf(extra, sizeof(extra), "\"guests\":%d,", guests);
+
+	bench_result("cycle_create", extra, 1, bench_cycle(guests, 1, base));
+
+	for (c = 2; c < cycles + 2; c++)
+		ns += bench_cycle(guests, c, base + (c - 1) * STEP);
+
+	bench_result("cycle", extra, cycles, ns);
+}
+
+static
+void bench_soak(int guests, int cycles, time_t base)
+{
+	long rss0 = bench_rss();
+	unsigned long live0 = allocs - frees;
+	int c;
+
+	for (c = 1; c <= cycles; c++) {
+		uint64_t ns = bench_cycle(guests, c, base + c * STEP);
+
+		printf("{\"tag\":\"%s\",\"soak\":%d,\"guests\":%d,\"ms\":%.3f,"
+		       "\"rss_kb\":%ld,\"allocs\":%lu,\"frees\":%lu,\"live\":%lu,"
+		       "\"heap\":%zu}\n",
+		       tag, c, guests, ns / 1e6, bench_rss(),
+		       allocs, frees, allocs - frees, bench_heap());
+		fflush(stdout);
+	}
+
+	printf("{\"tag\":\"%s\",\"soak_summary\":%d,\"rss_growth_kb\":%ld,"
+	       "\"live_growth\":%ld}\n",
+	       tag, cycles, bench_rss() - rss0,
+	       (long) (allocs - frees) - (long) live0);
+}
+
+static
+int bench_rm(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	char tmpdir[] = "/dev/shm/vstatd-bench.XXXXXX";
+	const char *datadir = NULL;
+	unsigned long n = 10000;
+	int c, guests = 10, cycles = 3, soak = 0;
+
+	while ((c = getopt(argc, argv, "D:n:k:c:s:t:")) != -1) {
+		switch (c) {
+		case 'D':
+			datadir = optarg;
+			break;
+
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+
+		case 'k':
+			guests = atoi(optarg);
+			break;
+
+		case 'c':
+			cycles = atoi(optarg);
+			break;
+
+		case 's':
+			soak = atoi(optarg);
+			break;
+
+		case 't':
+			tag = optarg;
+			break;
+
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (argc > optind)
+		usage(EXIT_FAILURE);
+
+	log_options_t log_options = {
+		.log_ident    = argv[0],
+		.log_dest     = LOGD_STDERR,
+		.log_opts     = LOGO_PRIO|LOGO_IDENT,
+		.log_facility = LOG_DAEMON,
+	};
+
+	log_init(&log_options);
+
+	if (!datadir && !(datadir = mkdtemp(tmpdir))) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+
+	cfg = cfg_init(BENCH_OPTS, CFGF_NOCASE);
+	cfg_setstr(cfg, "datadir", datadir);
+
+	/* all timestamps are synthetic and advance one step per cycle */
+	time_t base = time(NULL);
+	base -= base % STEP;
+
+	if (n > 0) {
+		bench_align(n);
+		bench_format(n / 10, base);
+		bench_update(n / 100 > 0 ? n / 100 : 1, base);
+		bench_guests(3, base);
+	}
+
+	if (guests > 0) {
+		bench_procfs(guests, datadir, base);
+		bench_cgroup(guests, datadir);
+	}
+
+	if (cycles > 0)
+		bench_cycles(guests, cycles, base);
+
+	if (soak > 0)
+		bench_soak(guests, soak, base + (cycles + 2) * STEP);
+
+	if (datadir == tmpdir)
+		nftw(tmpdir, bench_rm, 16, FTW_DEPTH|FTW_PHYS);
+
+	cfg_free(cfg);
+	log_close();
+
+	exit(failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
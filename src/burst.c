@@ -0,0 +1,561 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rrd.h>
+
+#include "adapt.h"
+#include "burst.h"
+#include "cfg.h"
+#include "cgroup.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+
+/* samples kept per context and metric between two folds, later ones are
+ * dropped until the next fold; the interval is raised until the longest
+ * time between two folds fits with some slack */
+#define BURST_MAXSAMPLES 64
+#define BURST_SLACK      8
+
+/* only counters that cost one syscall each are read between steps */
+typedef struct {
+	xid_t id;
+	unsigned int cycle;
+	uint64_t bytes, now;
+	int n[BURST_NR];
+	uint64_t v[BURST_NR][BURST_MAXSAMPLES];
+} burst_t;
+
+/* one reading of a context, taken without holding the lock */
+typedef struct {
+	xid_t id;
+	int ok, net;
+	uint64_t running, unintr, bytes, now;
+} burst_tick_t;
+
+/* the sampler thread copies the ids out of BURSTS under lock, reads the
+ * counters without it and adds them under lock again, so the main thread
+ * only ever waits for a copy; entries are only added and removed by the
+ * main thread, which holds the same lock while doing so */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static int running = 0, stop = 0;
+static long interval = 0;
+
+/* sorted by id */
+static burst_t *BURSTS = NULL;
+static int bursts_len = 0, bursts_size = 0;
+
+/* contexts seen for the first time this cycle, added by burst_sweep */
+static xid_t *fresh = NULL;
+static int fresh_len = 0, fresh_size = 0;
+
+static
+uint64_t burst_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline
+void burst_add(burst_t *b, int k, uint64_t v)
+{
+	if (b->n[k] < BURST_MAXSAMPLES)
+		b->v[k][b->n[k]++] = v;
+}
+
+/* runs in the sampler thread, so only libc and libvserver are used */
+static
+void burst_read(burst_tick_t *t)
+{
+	vx_stat_t vs;
+	nx_sock_stat_t ns;
+	int i;
+
+	t->ok = t->net = 0;
+	t->bytes = 0;
+
+	if (vx_stat(t->id, &vs) == -1)
+		return;
+
+	t->running = vs.nr_running;
+	t->unintr  = vs.nr_unintr;
+	t->now     = burst_now();
+	t->ok      = 1;
+
+	for (i = 0; i < 2; i++) {
+		ns.id = i ? NXA_SOCK_INET6 : NXA_SOCK_INET;
+
+		if (nx_sock_stat(t->id, &ns) == -1)
+			return;
+
+		t->bytes += ns.total[0] + ns.total[1];
+	}
+
+	t->net = 1;
+}
+
+static
+void burst_tick(burst_t *b, const burst_tick_t *t)
+{
+	burst_add(b, BURST_RUNNING, t->running);
+	burst_add(b, BURST_UNINTR,  t->unintr);
+
+	if (!t->net)
+		return;
+
+	/* traffic is a rate between two ticks, counters going backwards
+	 * belong to a restarted context */
+	if (b->now && t->bytes >= b->bytes && t->now > b->now)
+		burst_add(b, BURST_NET, (uint64_t)
+		          ((double) (t->bytes - b->bytes) * 1e9 / (t->now - b->now)));
+
+	b->bytes = t->bytes;
+	b->now   = t->now;
+}
+
+static burst_t *burst_find(xid_t xid);
+
+static
+void *burst_loop(void *arg)
+{
+	struct timespec next;
+	sigset_t set;
+	burst_tick_t *ticks = NULL;
+	uint64_t now;
+	int i, n, size = 0;
+
+	/* signals are handled by the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (1) {
+		next.tv_nsec += interval;
+
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+		                       &next, NULL) == EINTR);
+
+		pthread_mutex_lock(&lock);
+
+		if (stop) {
+			pthread_mutex_unlock(&lock);
+			break;
+		}
+
+		if (bursts_len > size) {
+			burst_tick_t *p = realloc(ticks, bursts_len * sizeof(burst_tick_t));
+
+			if (p) {
+				ticks = p;
+				size  = bursts_len;
+			}
+		}
+
+		n = bursts_len < size ? bursts_len : size;
+
+		for (i = 0; i < n; i++)
+			ticks[i].id = BURSTS[i].id;
+
+		pthread_mutex_unlock(&lock);
+
+		for (i = 0; i < n; i++)
+			burst_read(&ticks[i]);
+
+		/* contexts swept in the meantime are just not found */
+		pthread_mutex_lock(&lock);
+
+		for (i = 0; i < n; i++) {
+			burst_t *b;
+
+			if (ticks[i].ok && (b = burst_find(ticks[i].id)))
+				burst_tick(b, &ticks[i]);
+		}
+
+		pthread_mutex_unlock(&lock);
+
+		now = burst_now();
+
+		/* a tick that overran its slot does not cause a catch-up burst */
+		if (now > (uint64_t) next.tv_sec * 1000000000ULL + next.tv_nsec) {
+			next.tv_sec  = now / 1000000000ULL;
+			next.tv_nsec = now % 1000000000ULL;
+		}
+	}
+
+	free(ticks);
+	return NULL;
+}
+
+int burst_init(void)
+{
+	LOG_TRACEME
+
+	long msec = cfg_getint(cfg, "burst");
+	long floor = adapt_maxinterval() * 1000L / (BURST_MAXSAMPLES - BURST_SLACK);
+
+	/* called again on reload, the table starts over with the thread */
+	if (running) {
+		pthread_mutex_lock(&lock);
+		stop = 1;
+		pthread_mutex_unlock(&lock);
+
+		pthread_join(thread, NULL);
+		running = stop = 0;
+	}
+
+	bursts_len = 0;
+	fresh_len  = 0;
+
+	/* cgroups have no cheap per-guest counters to sample */
+	if (msec <= 0 || cgroup_enabled())
+		return 0;
+
+	/* everything sampled until the next fold has to fit, which adaptive
+	 * sampling may put off up to its longest interval */
+	if (msec < floor) {
+		log_warn("burst interval raised from %ld to %ld ms", msec, floor);
+		msec = floor;
+	}
+
+	if (msec >= STEP * 1000L) {
+		log_warn("burst interval of %ld ms is not below the step, "
+		         "burst sampling disabled", msec);
+		return 0;
+	}
+
+	interval = msec * 1000000L;
+
+	if ((errno = pthread_create(&thread, NULL, burst_loop, NULL)) != 0) {
+		log_perror("pthread_create");
+		return -1;
+	}
+
+	running = 1;
+	return 0;
+}
+
+static
+int burst_cmp_id(const void *a, const void *b)
+{
+	const burst_t *x = a, *y = b;
+
+	return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static
+int burst_cmp_u64(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static
+burst_t *burst_find(xid_t xid)
+{
+	burst_t key;
+
+	key.id = xid;
+	return bsearch(&key, BURSTS, bursts_len, sizeof(burst_t), burst_cmp_id);
+}
+
+/* every guest of a cycle is marked, sampled or not, so only departed
+ * contexts are dropped by burst_sweep */
+void burst_mark(xid_t xid, unsigned int cycle)
+{
+	LOG_TRACEME
+
+	burst_t *b;
+
+	if (!running)
+		return;
+
+	pthread_mutex_lock(&lock);
+
+	if ((b = burst_find(xid)) != NULL) {
+		b->cycle = cycle;
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (fresh_len == fresh_size) {
+		int size = fresh_size ? fresh_size * 2 : 64;
+		xid_t *p = mem_realloc(fresh, size * sizeof(xid_t));
+
+		if (!p) {
+			log_perror("mem_realloc");
+			return;
+		}
+
+		fresh      = p;
+		fresh_size = size;
+	}
+
+	fresh[fresh_len++] = xid;
+}
+
+/* summarize everything sampled since the last fold into s; the p99 is
+ * interpolated between the two closest ranks, with a few dozen samples
+ * per step the nearest rank would always be the maximum. Every metric is
+ * folded on its own, one without samples (no traffic rate yet, or a
+ * context without network) is left unknown */
+void burst_fold(sample_t *s)
+{
+	LOG_TRACEME
+
+	uint64_t v[BURST_NR][BURST_MAXSAMPLES];
+	int n[BURST_NR], k, total = 0;
+	burst_t *b;
+
+	s->burst_time = 0;
+
+	if (!running)
+		return;
+
+	pthread_mutex_lock(&lock);
+
+	if ((b = burst_find(s->id)) == NULL) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	for (k = 0; k < BURST_NR; k++) {
+		n[k] = b->n[k];
+		memcpy(v[k], b->v[k], n[k] * sizeof(uint64_t));
+		b->n[k] = 0;
+		total += n[k];
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (total < 1)
+		return;
+
+	for (k = 0; k < BURST_NR; k++) {
+		double rank = (n[k] - 1) * 0.99;
+		int lo = (int) rank;
+		int hi = lo + 1 < n[k] ? lo + 1 : lo;
+
+		if (n[k] < 1) {
+			s->burst[k].min = s->burst[k].max = s->burst[k].p99 = SAMPLE_UNKNOWN;
+			continue;
+		}
+
+		qsort(v[k], n[k], sizeof(uint64_t), burst_cmp_u64);
+
+		s->burst[k].min = v[k][0];
+		s->burst[k].max = v[k][n[k] - 1];
+		s->burst[k].p99 = v[k][lo] + (uint64_t)
+		                  ((rank - lo) * (v[k][hi] - v[k][lo]));
+	}
+
+	s->burst_time = time(NULL);
+}
+
+/* drop contexts not seen this cycle and start sampling new ones */
+void burst_sweep(unsigned int cycle)
+{
+	LOG_TRACEME
+
+	int i, j;
+
+	if (!running)
+		return;
+
+	pthread_mutex_lock(&lock);
+
+	for (i = j = 0; i < bursts_len; i++)
+		if (BURSTS[i].cycle == cycle)
+			BURSTS[j++] = BURSTS[i];
+
+	bursts_len = j;
+
+	if (bursts_len + fresh_len > bursts_size) {
+		int size = bursts_size ? bursts_size : 64;
+		burst_t *p;
+
+		while (size < bursts_len + fresh_len)
+			size *= 2;
+
+		if ((p = mem_realloc(BURSTS, size * sizeof(burst_t))) == NULL) {
+			log_perror("mem_realloc");
+			pthread_mutex_unlock(&lock);
+			fresh_len = 0;
+			return;
+		}
+
+		BURSTS      = p;
+		bursts_size = size;
+	}
+
+	for (i = 0; i < fresh_len; i++) {
+		burst_t *b = &BURSTS[bursts_len++];
+
+		memset(b, 0, sizeof(burst_t));
+		b->id    = fresh[i];
+		b->cycle = cycle;
+	}
+
+	if (fresh_len > 0)
+		qsort(BURSTS, bursts_len, sizeof(burst_t), burst_cmp_id);
+
+	pthread_mutex_unlock(&lock);
+	fresh_len = 0;
+}
+
+#define BURST_MAXDS 6
+
+static
+int burst_rrd_create(char *path, char **ds, int nds)
+{
+	LOG_TRACEME
+
+	char timestr[32];
+	time_t curtime = vrrd_begin();
+
+	char *head[] = { "create", path, "-b", timestr, "-s", STEP_STR };
+	char *rra[]  = { RRA_DEFAULT };
+	char *argv[sizeof(head) / sizeof(*head) + BURST_MAXDS + sizeof(rra) / sizeof(*rra)];
+	int argc = 0, i;
+
+	for (i = 0; i < (int) (sizeof(head) / sizeof(*head)); i++)
+		argv[argc++] = head[i];
+
+	for (i = 0; i < nds && i < BURST_MAXDS; i++)
+		argv[argc++] = ds[i];
+
+	for (i = 0; i < (int) (sizeof(rra) / sizeof(*rra)); i++)
+		argv[argc++] = rra[i];
+
+	snprintf(timestr, 32, "%ld", curtime - STEP - (curtime % STEP));
+
+	if (mkdirnamep(path, 0700) == -1) {
+		log_perror("mkdirnamep(%s)", path);
+		return -1;
+	}
+
+	if (rrd_create(argc, argv) == -1) {
+		log_error("rrd_create(%s): %s", path, rrd_get_error());
+		rrd_clear_error();
+		return -1;
+	}
+
+	return 0;
+}
+
+static char *THREADS_DS[] = {
+	"DS:running_min:GAUGE:" HEARTBEAT ":0:U",
+	"DS:running_max:GAUGE:" HEARTBEAT ":0:U",
+	"DS:running_p99:GAUGE:" HEARTBEAT ":0:U",
+	"DS:unintr_min:GAUGE:"  HEARTBEAT ":0:U",
+	"DS:unintr_max:GAUGE:"  HEARTBEAT ":0:U",
+	"DS:unintr_p99:GAUGE:"  HEARTBEAT ":0:U",
+};
+
+static char *NET_DS[] = {
+	"DS:min:GAUGE:" HEARTBEAT ":0:U",
+	"DS:max:GAUGE:" HEARTBEAT ":0:U",
+	"DS:p99:GAUGE:" HEARTBEAT ":0:U",
+};
+
+int burst_rrd_check(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *threads = NULL, *net = NULL;
+	int rc = 0;
+
+	asprintf(&threads, "%s/%s/burst_THREADS.rrd", datadir, s->name);
+	asprintf(&net,     "%s/%s/burst_NET.rrd",     datadir, s->name);
+
+	if ((!isfile(threads) && burst_rrd_create(threads, THREADS_DS, 6) == -1) ||
+	    (!isfile(net)     && burst_rrd_create(net,     NET_DS,     3) == -1))
+		rc = -1;
+
+	mem_free(threads);
+	mem_free(net);
+
+	return rc;
+}
+
+/* ":min:max:p99" of one metric, unknown if it was not sampled */
+static
+void burst_fmt(char *buf, size_t len, const sample_t *s, int k)
+{
+	if (s->burst[k].min == SAMPLE_UNKNOWN)
+		snprintf(buf, len, ":U:U:U");
+	else
+		snprintf(buf, len, ":%" PRIu64 ":%" PRIu64 ":%" PRIu64,
+		         s->burst[k].min, s->burst[k].max, s->burst[k].p99);
+}
+
+int burst_rrd_update(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *buf = NULL, v[BURST_NR][64];
+	int k;
+
+	for (k = 0; k < BURST_NR; k++)
+		burst_fmt(v[k], sizeof(v[k]), s, k);
+
+	asprintf(&buf,
+		"update %s/%s/burst_THREADS.rrd %ld%s%s",
+		datadir,
+		s->name,
+		vrrd_align_time(s->burst_time),
+		v[BURST_RUNNING],
+		v[BURST_UNINTR]);
+
+	int rc = vrrd_update(s->name, buf);
+
+	buf = NULL;
+
+	asprintf(&buf,
+		"update %s/%s/burst_NET.rrd %ld%s",
+		datadir,
+		s->name,
+		vrrd_align_time(s->burst_time),
+		v[BURST_NET]);
+
+	if (vrrd_update(s->name, buf) == -1)
+		rc = -1;
+
+	return rc;
+}
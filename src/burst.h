@@ -0,0 +1,29 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_BURST_H
+#define _VSTATD_BURST_H
+
+#include <vserver.h>
+
+#include "sample.h"
+
+int  burst_init (void);
+void burst_mark (xid_t xid, unsigned int cycle);
+void burst_fold (sample_t *s);
+void burst_sweep(unsigned int cycle);
+
+#endif
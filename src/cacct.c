@@ -16,9 +16,11 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 
 #include <inttypes.h>
+#include <string.h>
 #include <rrd.h>
 
 #include "cfg.h"
+#include "rate.h"
 #include "vrrd.h"
 
 #define _LUCID_PRINTF_MACROS
@@ -26,31 +28,26 @@
 #include <lucid/mem.h>
 #include <lucid/misc.h>
 #include <lucid/printf.h>
-#include <lucid/strtok.h>
 
 static
 struct cacct_data {
 	uint32_t id;
 	char *db;
-	uint64_t recvp, recvb;
-	uint64_t sendp, sendb;
-	uint64_t failp, failb;
 } CACCT[] = {
-	{ NXA_SOCK_UNSPEC, "net_UNSPEC", 0, 0, 0, 0, 0, 0 },
-	{ NXA_SOCK_UNIX,   "net_UNIX",   0, 0, 0, 0, 0, 0 },
-	{ NXA_SOCK_INET,   "net_INET",   0, 0, 0, 0, 0, 0 },
-	{ NXA_SOCK_INET6,  "net_INET6",  0, 0, 0, 0, 0, 0 },
-	{ NXA_SOCK_PACKET, "net_PACKET", 0, 0, 0, 0, 0, 0 },
-	{ NXA_SOCK_OTHER,  "net_OTHER",  0, 0, 0, 0, 0, 0 },
-	{ 0,               NULL,         0, 0, 0, 0, 0, 0 }
+	{ NXA_SOCK_UNSPEC, "net_UNSPEC" },
+	{ NXA_SOCK_UNIX,   "net_UNIX" },
+	{ NXA_SOCK_INET,   "net_INET" },
+	{ NXA_SOCK_INET6,  "net_INET6" },
+	{ NXA_SOCK_PACKET, "net_PACKET" },
+	{ NXA_SOCK_OTHER,  "net_OTHER" },
+	{ 0,               NULL }
 };
 
-int cacct_fetch(xid_t xid, time_t *curtime)
+int cacct_fetch(xid_t xid, sample_t *s)
 {
 	LOG_TRACEME
 
-	if (curtime)
-		*curtime = time(NULL);
+	s->cacct_time = time(NULL);
 
 	int i;
 
@@ -64,26 +61,26 @@ int cacct_fetch(xid_t xid, time_t *curtime)
 			return -1;
 		}
 
-		CACCT[i].recvp = sb.count[0];
-		CACCT[i].recvb = sb.total[0];
-		CACCT[i].sendp = sb.count[1];
-		CACCT[i].sendb = sb.total[1];
-		CACCT[i].failp = sb.count[2];
-		CACCT[i].failb = sb.total[2];
+		s->cacct[i].recvp = sb.count[0];
+		s->cacct[i].recvb = sb.total[0];
+		s->cacct[i].sendp = sb.count[1];
+		s->cacct[i].sendb = sb.total[1];
+		s->cacct[i].failp = sb.count[2];
+		s->cacct[i].failb = sb.total[2];
 	}
 
 	return 0;
 }
 
 static
-int cacct_rrd_create(char *path)
+int cacct_rrd_create(char *path, int schema)
 {
 	LOG_TRACEME
 
 	char timestr[32];
-	time_t curtime = time(NULL);
+	time_t curtime = vrrd_begin();
 
-	char *argv[] = {
+	char *raw[] = {
 		"create", path, "-b", timestr, "-s", STEP_STR,
 		"DS:recvp:GAUGE:" HEARTBEAT ":0:18446744073709551615",
 		"DS:recvb:GAUGE:" HEARTBEAT ":0:18446744073709551615",
@@ -94,7 +91,23 @@ int cacct_rrd_create(char *path)
 		RRA_DEFAULT
 	};
 
-	int argc = sizeof(argv) / sizeof(*argv);
+	/* per second rates and average packet sizes */
+	char *rate[] = {
+		"create", path, "-b", timestr, "-s", STEP_STR,
+		"DS:recvp:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:recvb:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:sendp:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:sendb:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:failp:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:failb:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:recvsz:GAUGE:" HEARTBEAT ":0:U",
+		"DS:sendsz:GAUGE:" HEARTBEAT ":0:U",
+		RRA_DEFAULT
+	};
+
+	char **argv = schema == SCHEMA_RATE ? rate : raw;
+	int argc = schema == SCHEMA_RATE ? sizeof(rate) / sizeof(*rate)
+	                                 : sizeof(raw) / sizeof(*raw);
 
 	snprintf(timestr, 32, "%ld", curtime - STEP - (curtime % STEP));
 
@@ -112,7 +125,7 @@ int cacct_rrd_create(char *path)
 	return 0;
 }
 
-int cacct_rrd_check(char *name)
+int cacct_rrd_check(sample_t *s)
 {
 	LOG_TRACEME
 
@@ -122,9 +135,9 @@ int cacct_rrd_check(char *name)
 	for (i = 0; CACCT[i].db; i++) {
 		char *path = NULL;
 
-		asprintf(&path, "%s/%s/%s.rrd", datadir, name, CACCT[i].db);
+		asprintf(&path, "%s/%s/%s.rrd", datadir, s->name, CACCT[i].db);
 
-		if (!isfile(path) && cacct_rrd_create(path) == -1) {
+		if (!isfile(path) && cacct_rrd_create(path, rate_create_schema()) == -1) {
 			mem_free(path);
 			return -1;
 		}
@@ -135,61 +148,92 @@ int cacct_rrd_check(char *name)
 	return 0;
 }
 
-int cacct_rrd_update(char *name, time_t curtime)
+static
+char *cacct_rates(char *path, sample_t *s, rate_t *last, int i)
+{
+	LOG_TRACEME
+
+	time_t dt = last->cacct_time ? s->cacct_time - last->cacct_time : 0;
+	char *buf = NULL, v[8][RATE_BUFLEN];
+	int valid[6], j;
+
+	uint64_t d[6] = { 0, 0, 0, 0, 0, 0 };
+
+	uint64_t cur[6] = {
+		s->cacct[i].recvp, s->cacct[i].recvb,
+		s->cacct[i].sendp, s->cacct[i].sendb,
+		s->cacct[i].failp, s->cacct[i].failb,
+	};
+
+	uint64_t prev[6] = {
+		last->cacct[i].recvp, last->cacct[i].recvb,
+		last->cacct[i].sendp, last->cacct[i].sendb,
+		last->cacct[i].failp, last->cacct[i].failb,
+	};
+
+	for (j = 0; j < 6; j++) {
+		valid[j] = dt > 0 && rate_delta(cur[j], prev[j], &d[j]) == 0;
+		rate_fmt(v[j], valid[j], d[j], dt, 1);
+	}
+
+	rate_fmt(v[6], valid[0] && valid[1], d[1], d[0], 1);
+	rate_fmt(v[7], valid[2] && valid[3], d[3], d[2], 1);
+
+	asprintf(&buf, "update %s %ld:%s:%s:%s:%s:%s:%s:%s:%s",
+	         path, vrrd_align_time(s->cacct_time),
+	         v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+
+	return buf;
+}
+
+int cacct_rrd_update(sample_t *s)
 {
 	LOG_TRACEME
 
 	const char *datadir = cfg_getstr(cfg, "datadir");
-	int i;
+	rate_t *r = rate_get(s->name), last;
+	int i, rc = 0;
 
-	for (i = 0; CACCT[i].db; i++) {
-		char *buf = NULL;
-
-		asprintf(&buf,
-			"update %s/%s/%s.rrd %ld"
-			":%" PRIu64 ":%" PRIu64
-			":%" PRIu64 ":%" PRIu64
-			":%" PRIu64 ":%" PRIu64,
-			datadir,
-			name,
-			CACCT[i].db,
-			vrrd_align_time(curtime),
-			CACCT[i].recvp,
-			CACCT[i].recvb,
-			CACCT[i].sendp,
-			CACCT[i].sendb,
-			CACCT[i].failp,
-			CACCT[i].failb);
-
-		strtok_t _st, *st = &_st;
-
-		if (!strtok_init_str(st, buf, " ", 0)) {
-			mem_free(buf);
-			return -1;
-		}
+	if (!r)
+		return -1;
 
-		mem_free(buf);
+	/* counters are remembered for raw files too, so a file recreated with
+	 * the rate schema starts with a valid previous reading */
+	last = *r;
 
-		int argc    = strtok_count(st);
-		char **argv = mem_alloc((argc + 1) * sizeof(char *));
+	if (s->cacct_time > r->cacct_time) {
+		r->cacct_time = s->cacct_time;
+		memcpy(r->cacct, s->cacct, sizeof(r->cacct));
+	}
 
-		if (!argv) {
-			mem_free(argv);
-			strtok_free(st);
-			return -1;
-		}
+	for (i = 0; CACCT[i].db; i++) {
+		char *path = NULL, *buf = NULL;
+
+		asprintf(&path, "%s/%s/%s.rrd", datadir, s->name, CACCT[i].db);
+
+		if (rate_schema(path, "recvsz", &r->cacct_schema[i]) == SCHEMA_RATE)
+			buf = cacct_rates(path, s, &last, i);
+
+		else
+			asprintf(&buf,
+				"update %s %ld"
+				":%" PRIu64 ":%" PRIu64
+				":%" PRIu64 ":%" PRIu64
+				":%" PRIu64 ":%" PRIu64,
+				path,
+				vrrd_align_time(s->cacct_time),
+				s->cacct[i].recvp,
+				s->cacct[i].recvb,
+				s->cacct[i].sendp,
+				s->cacct[i].sendb,
+				s->cacct[i].failp,
+				s->cacct[i].failb);
 
-		if (strtok_toargv(st, argv) < 1) {
-			strtok_free(st);
-			return -1;
-		}
+		mem_free(path);
 
-		if (rrd_update(argc, argv) == -1) {
-			log_error("rrd_update(%s): %s", name, rrd_get_error());
-			rrd_clear_error();
-			return -1;
-		}
+		if (vrrd_update(s->name, buf) == -1)
+			rc = -1;
 	}
 
-	return 0;
+	return rc;
 }
@@ -14,6 +14,9 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include <lucid/log.h>
@@ -47,3 +50,35 @@ int cfg_validate_path(cfg_t *cfg, cfg_opt_t *opt,
 	*(const char **) result = (const char *) value;
 	return 0;
 }
+
+/* compare the printed form, which covers lists and sections as well */
+int cfg_changed(cfg_t *old, const char *name)
+{
+	LOG_TRACEME
+
+	char *a = NULL, *b = NULL;
+	size_t alen = 0, blen = 0;
+	int changed = 1;
+
+	FILE *fa = open_memstream(&a, &alen);
+	FILE *fb = open_memstream(&b, &blen);
+
+	if (fa && fb) {
+		cfg_opt_print(cfg_getopt(old, name), fa);
+		cfg_opt_print(cfg_getopt(cfg, name), fb);
+	}
+
+	if (fa)
+		fclose(fa);
+
+	if (fb)
+		fclose(fb);
+
+	if (fa && fb)
+		changed = alen != blen || memcmp(a, b, alen) != 0;
+
+	free(a);
+	free(b);
+
+	return changed;
+}
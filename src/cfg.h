@@ -22,6 +22,7 @@
 extern cfg_t *cfg;
 
 void cfg_atexit(void);
+int  cfg_changed(cfg_t *old, const char *name);
 
 int cfg_validate_path(cfg_t *cfg, cfg_opt_t *opt,
                       const char *value, void *result);
@@ -0,0 +1,488 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <rrd.h>
+#include <sys/stat.h>
+
+#include "cfg.h"
+#include "cgroup.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+
+enum {
+	CG_CPU_STAT,
+	CG_MEMORY_CURRENT,
+	CG_MEMORY_MAX,
+	CG_PIDS_CURRENT,
+	CG_PIDS_MAX,
+	CG_IO_STAT,
+	CG_NR
+};
+
+static const char *FILES[CG_NR] = {
+	"cpu.stat",
+	"memory.current",
+	"memory.max",
+	"pids.current",
+	"pids.max",
+	"io.stat",
+};
+
+/* the files of every guest stay open, so one pread per file and cycle is
+ * all it takes to sample a guest */
+typedef struct {
+	uint64_t id;
+	unsigned int cycle;
+	int fd[CG_NR];
+} cgroup_t;
+
+/* open addressing hash keyed by cgroup inode, size is always a power of two */
+static cgroup_t **CGROUPS = NULL;
+static unsigned int cgroups_size = 0;
+static unsigned int cgroups_used = 0;
+
+static int enabled = 0;
+static char buf[16384];
+
+static inline
+unsigned int cgroup_hash(uint64_t id)
+{
+	return (unsigned int) ((id * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static
+void cgroup_insert(cgroup_t **table, unsigned int size, cgroup_t *c)
+{
+	unsigned int i = cgroup_hash(c->id) & (size - 1);
+
+	while (table[i])
+		i = (i + 1) & (size - 1);
+
+	table[i] = c;
+}
+
+static
+int cgroup_resize(unsigned int size)
+{
+	LOG_TRACEME
+
+	cgroup_t **table = mem_alloc(size * sizeof(cgroup_t *));
+	unsigned int i;
+
+	if (!table)
+		return -1;
+
+	memset(table, 0, size * sizeof(cgroup_t *));
+
+	for (i = 0; i < cgroups_size; i++)
+		if (CGROUPS[i])
+			cgroup_insert(table, size, CGROUPS[i]);
+
+	mem_free(CGROUPS);
+
+	CGROUPS      = table;
+	cgroups_size = size;
+
+	return 0;
+}
+
+static
+cgroup_t *cgroup_get(int dirfd, const char *name, uint64_t id, unsigned int cycle)
+{
+	LOG_TRACEME
+
+	unsigned int i;
+	int f, gfd;
+
+	if (cgroups_size > 0) {
+		i = cgroup_hash(id) & (cgroups_size - 1);
+
+		for (; CGROUPS[i]; i = (i + 1) & (cgroups_size - 1)) {
+			if (CGROUPS[i]->id == id) {
+				CGROUPS[i]->cycle = cycle;
+				return CGROUPS[i];
+			}
+		}
+	}
+
+	/* keep the load factor below 1/2 */
+	if ((cgroups_used + 1) * 2 > cgroups_size &&
+	    cgroup_resize(cgroups_size ? cgroups_size * 2 : 64) == -1)
+		return NULL;
+
+	if ((gfd = openat(dirfd, name, O_RDONLY|O_DIRECTORY)) == -1) {
+		log_perror("openat(%s)", name);
+		return NULL;
+	}
+
+	cgroup_t *c = mem_alloc(sizeof(cgroup_t));
+
+	if (!c) {
+		close(gfd);
+		return NULL;
+	}
+
+	c->id    = id;
+	c->cycle = cycle;
+
+	/* controllers that are not enabled for the subtree have no files */
+	for (f = 0; f < CG_NR; f++)
+		c->fd[f] = openat(gfd, FILES[f], O_RDONLY);
+
+	close(gfd);
+
+	cgroup_insert(CGROUPS, cgroups_size, c);
+	cgroups_used++;
+
+	return c;
+}
+
+static
+void cgroup_sweep(unsigned int cycle)
+{
+	LOG_TRACEME
+
+	unsigned int i, removed = 0;
+	int f;
+
+	for (i = 0; i < cgroups_size; i++) {
+		if (CGROUPS[i] && CGROUPS[i]->cycle != cycle) {
+			for (f = 0; f < CG_NR; f++)
+				if (CGROUPS[i]->fd[f] != -1)
+					close(CGROUPS[i]->fd[f]);
+
+			mem_free(CGROUPS[i]);
+			CGROUPS[i] = NULL;
+			cgroups_used--;
+			removed++;
+		}
+	}
+
+	/* linear probing does not support holes, so rehash the survivors */
+	if (removed > 0)
+		cgroup_resize(cgroups_size);
+}
+
+/* read a whole file with a single syscall into the shared buffer */
+static
+char *cgroup_read(cgroup_t *c, int f)
+{
+	ssize_t len;
+
+	if (c->fd[f] == -1)
+		return NULL;
+
+	if ((len = pread(c->fd[f], buf, sizeof(buf) - 1, 0)) == -1) {
+		log_perror("pread(%s)", FILES[f]);
+		return NULL;
+	}
+
+	buf[len] = '\0';
+	return buf;
+}
+
+/* a single value file, unknown if the controller is not enabled for the
+ * group or the file cannot be read; "max" in a limit file means unlimited
+ * and is stored as 0 */
+static
+uint64_t cgroup_value(cgroup_t *c, int f)
+{
+	char *p = cgroup_read(c, f);
+
+	if (!p)
+		return SAMPLE_UNKNOWN;
+
+	if ((f == CG_MEMORY_MAX || f == CG_PIDS_MAX) && strncmp(p, "max", 3) == 0)
+		return 0;
+
+	return strtoull(p, NULL, 10);
+}
+
+/* value of "key value" in a flat keyed file */
+static
+uint64_t cgroup_key(const char *p, const char *key)
+{
+	size_t len = strlen(key);
+
+	while (p && *p) {
+		if (strncmp(p, key, len) == 0 && p[len] == ' ')
+			return strtoull(p + len + 1, NULL, 10);
+
+		if ((p = strchr(p, '\n')))
+			p++;
+	}
+
+	return 0;
+}
+
+/* sum of "key=value" over all devices in a nested keyed file */
+static
+uint64_t cgroup_nested(const char *buf, const char *key)
+{
+	const char *p = buf;
+	size_t len = strlen(key);
+	uint64_t sum = 0;
+
+	while ((p = strstr(p, key))) {
+		if (p > buf && (p[-1] == ' ' || p[-1] == '\n') && p[len] == '=')
+			sum += strtoull(p + len + 1, NULL, 10);
+
+		p += len;
+	}
+
+	return sum;
+}
+
+static
+void cgroup_fetch(cgroup_t *c, sample_t *s)
+{
+	LOG_TRACEME
+
+	time_t now = time(NULL);
+	char *p;
+	int i;
+
+	s->cvirt_time  = now;
+	s->limit_time  = now;
+	s->cgroup_time = now;
+
+	/* only the files of what cgroups have an equivalent for are written */
+	for (i = 0; i < CVIRT_NR; i++)
+		s->cvirt[i] = SAMPLE_UNKNOWN;
+
+	for (i = 0; i < LIMIT_NR; i++)
+		s->limit[i].min = s->limit[i].cur = s->limit[i].max = SAMPLE_UNKNOWN;
+
+	s->cvirt[CVIRT_TOTAL] = cgroup_value(c, CG_PIDS_CURRENT);
+
+	/* the same layout as vserver limits, with the configured limit in
+	 * place of the watermark, so utilization is cur / max */
+	s->limit[LIMIT_RSS].cur = cgroup_value(c, CG_MEMORY_CURRENT);
+	s->limit[LIMIT_RSS].min = s->limit[LIMIT_RSS].cur;
+	s->limit[LIMIT_RSS].max = cgroup_value(c, CG_MEMORY_MAX);
+
+	s->limit[LIMIT_NPROC].cur = s->cvirt[CVIRT_TOTAL];
+	s->limit[LIMIT_NPROC].min = s->cvirt[CVIRT_TOTAL];
+	s->limit[LIMIT_NPROC].max = cgroup_value(c, CG_PIDS_MAX);
+
+	if ((p = cgroup_read(c, CG_CPU_STAT))) {
+		s->cpu.user      = cgroup_key(p, "user_usec");
+		s->cpu.system    = cgroup_key(p, "system_usec");
+		s->cpu.throttled = cgroup_key(p, "throttled_usec");
+	}
+
+	if ((p = cgroup_read(c, CG_IO_STAT))) {
+		s->io.rbytes = cgroup_nested(p, "rbytes");
+		s->io.wbytes = cgroup_nested(p, "wbytes");
+		s->io.rios   = cgroup_nested(p, "rios");
+		s->io.wios   = cgroup_nested(p, "wios");
+	}
+}
+
+int cgroup_init(void)
+{
+	LOG_TRACEME
+
+	const char *backend = cfg_getstr(cfg, "backend");
+
+	enabled = backend && strcmp(backend, "cgroup") == 0;
+
+	/* a reload switched back to vserver, cycles start at 1 so this
+	 * closes every cached file */
+	if (!enabled)
+		cgroup_sweep(0);
+
+	return 0;
+}
+
+int cgroup_enabled(void)
+{
+	return enabled;
+}
+
+/* every directory directly below one of the configured subtrees is a guest */
+void cgroup_walk(unsigned int cycle, cgroup_cb_t cb)
+{
+	LOG_TRACEME
+
+	const char *root = cfg_getstr(cfg, "cgroup_root");
+	int i, n = cfg_size(cfg, "cgroups");
+
+	for (i = 0; i < n; i++) {
+		char *path = NULL;
+		DIR *dirp;
+		struct dirent *ditp;
+
+		asprintf(&path, "%s/%s", root, cfg_getnstr(cfg, "cgroups", i));
+
+		if ((dirp = opendir(path)) == NULL) {
+			log_perror("opendir(%s)", path);
+			mem_free(path);
+			continue;
+		}
+
+		while ((ditp = readdir(dirp)) != NULL) {
+			struct stat sb;
+			sample_t s;
+			cgroup_t *c;
+
+			if (ditp->d_name[0] == '.')
+				continue;
+
+			if (fstatat(dirfd(dirp), ditp->d_name, &sb, 0) == -1 ||
+			    !S_ISDIR(sb.st_mode))
+				continue;
+
+			if (!(c = cgroup_get(dirfd(dirp), ditp->d_name, sb.st_ino, cycle)))
+				continue;
+
+			memset(&s, 0, sizeof(s));
+
+			s.id = sb.st_ino;
+			snprintf(s.name, SAMPLE_NAMELEN, "%s", ditp->d_name);
+
+			cgroup_fetch(c, &s);
+			cb(&s);
+		}
+
+		closedir(dirp);
+		mem_free(path);
+	}
+
+	cgroup_sweep(cycle);
+}
+
+#define CG_MAXDS 4
+
+static
+int cgroup_rrd_create(char *path, char **ds, int nds)
+{
+	LOG_TRACEME
+
+	char timestr[32];
+	time_t curtime = vrrd_begin();
+
+	char *head[] = { "create", path, "-b", timestr, "-s", STEP_STR };
+	char *rra[]  = { RRA_DEFAULT };
+	char *argv[sizeof(head) / sizeof(*head) + CG_MAXDS + sizeof(rra) / sizeof(*rra)];
+	int argc = 0, i;
+
+	for (i = 0; i < (int) (sizeof(head) / sizeof(*head)); i++)
+		argv[argc++] = head[i];
+
+	for (i = 0; i < nds && i < CG_MAXDS; i++)
+		argv[argc++] = ds[i];
+
+	for (i = 0; i < (int) (sizeof(rra) / sizeof(*rra)); i++)
+		argv[argc++] = rra[i];
+
+	snprintf(timestr, 32, "%ld", curtime - STEP - (curtime % STEP));
+
+	if (mkdirnamep(path, 0700) == -1) {
+		log_perror("mkdirnamep(%s)", path);
+		return -1;
+	}
+
+	if (rrd_create(argc, argv) == -1) {
+		log_error("rrd_create(%s): %s", path, rrd_get_error());
+		rrd_clear_error();
+		return -1;
+	}
+
+	return 0;
+}
+
+static char *CPU_DS[] = {
+	"DS:user:GAUGE:"      HEARTBEAT ":0:18446744073709551615",
+	"DS:system:GAUGE:"    HEARTBEAT ":0:18446744073709551615",
+	"DS:throttled:GAUGE:" HEARTBEAT ":0:18446744073709551615",
+};
+
+static char *IO_DS[] = {
+	"DS:rbytes:GAUGE:" HEARTBEAT ":0:18446744073709551615",
+	"DS:wbytes:GAUGE:" HEARTBEAT ":0:18446744073709551615",
+	"DS:rios:GAUGE:"   HEARTBEAT ":0:18446744073709551615",
+	"DS:wios:GAUGE:"   HEARTBEAT ":0:18446744073709551615",
+};
+
+int cgroup_rrd_check(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *cpu = NULL, *io = NULL;
+	int rc = 0;
+
+	asprintf(&cpu, "%s/%s/cg_CPU.rrd", datadir, s->name);
+	asprintf(&io,  "%s/%s/cg_IO.rrd",  datadir, s->name);
+
+	if ((!isfile(cpu) && cgroup_rrd_create(cpu, CPU_DS, 3) == -1) ||
+	    (!isfile(io)  && cgroup_rrd_create(io,  IO_DS,  4) == -1))
+		rc = -1;
+
+	mem_free(cpu);
+	mem_free(io);
+
+	return rc;
+}
+
+int cgroup_rrd_update(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *buf = NULL;
+
+	asprintf(&buf,
+		"update %s/%s/cg_CPU.rrd %ld:%" PRIu64 ":%" PRIu64 ":%" PRIu64,
+		datadir,
+		s->name,
+		vrrd_align_time(s->cgroup_time),
+		s->cpu.user,
+		s->cpu.system,
+		s->cpu.throttled);
+
+	int rc = vrrd_update(s->name, buf);
+
+	buf = NULL;
+
+	asprintf(&buf,
+		"update %s/%s/cg_IO.rrd %ld"
+		":%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%" PRIu64,
+		datadir,
+		s->name,
+		vrrd_align_time(s->cgroup_time),
+		s->io.rbytes,
+		s->io.wbytes,
+		s->io.rios,
+		s->io.wios);
+
+	if (vrrd_update(s->name, buf) == -1)
+		rc = -1;
+
+	return rc;
+}
@@ -26,26 +26,23 @@
 #include <lucid/mem.h>
 #include <lucid/misc.h>
 #include <lucid/printf.h>
-#include <lucid/strtok.h>
 
 static
 struct cvirt_data {
 	char *db;
-	int value;
 } CVIRT[] = {
-	{ "thread_TOTAL",   0 },
-	{ "thread_RUNNING", 0 },
-	{ "thread_UNINTR",  0 },
-	{ "thread_ONHOLD",  0 },
-	{ NULL,             0 }
+	{ "thread_TOTAL" },
+	{ "thread_RUNNING" },
+	{ "thread_UNINTR" },
+	{ "thread_ONHOLD" },
+	{ NULL }
 };
 
-int cvirt_fetch(xid_t xid, time_t *curtime)
+int cvirt_fetch(xid_t xid, sample_t *s)
 {
 	LOG_TRACEME
 
-	if (curtime)
-		*curtime = time(NULL);
+	s->cvirt_time = time(NULL);
 
 	int i;
 
@@ -58,10 +55,10 @@ int cvirt_fetch(xid_t xid, time_t *curtime)
 		}
 
 		switch (i) {
-			case 0: CVIRT[i].value = sb.nr_threads; break;
-			case 1: CVIRT[i].value = sb.nr_running; break;
-			case 2: CVIRT[i].value = sb.nr_unintr; break;
-			case 3: CVIRT[i].value = sb.nr_onhold; break;
+			case CVIRT_TOTAL:   s->cvirt[i] = sb.nr_threads; break;
+			case CVIRT_RUNNING: s->cvirt[i] = sb.nr_running; break;
+			case CVIRT_UNINTR:  s->cvirt[i] = sb.nr_unintr; break;
+			case CVIRT_ONHOLD:  s->cvirt[i] = sb.nr_onhold; break;
 		}
 	}
 
@@ -74,7 +71,7 @@ int cvirt_rrd_create(char *path)
 	LOG_TRACEME
 
 	char timestr[32];
-	time_t curtime = time(NULL);
+	time_t curtime = vrrd_begin();
 
 	char *argv[] = {
 		"create", path, "-b", timestr, "-s", STEP_STR,
@@ -100,7 +97,7 @@ int cvirt_rrd_create(char *path)
 	return 0;
 }
 
-int cvirt_rrd_check(char *name)
+int cvirt_rrd_check(sample_t *s)
 {
 	LOG_TRACEME
 
@@ -110,7 +107,10 @@ int cvirt_rrd_check(char *name)
 	for (i = 0; CVIRT[i].db; i++) {
 		char *path = NULL;
 
-		asprintf(&path, "%s/%s/%s.rrd", datadir, name, CVIRT[i].db);
+		if (s->cvirt[i] == SAMPLE_UNKNOWN)
+			continue;
+
+		asprintf(&path, "%s/%s/%s.rrd", datadir, s->name, CVIRT[i].db);
 
 		if (!isfile(path) && cvirt_rrd_create(path) == -1) {
 			mem_free(path);
@@ -123,53 +123,30 @@ int cvirt_rrd_check(char *name)
 	return 0;
 }
 
-int cvirt_rrd_update(char *name, time_t curtime)
+int cvirt_rrd_update(sample_t *s)
 {
 	LOG_TRACEME
 
 	const char *datadir = cfg_getstr(cfg, "datadir");
-	int i;
+	int i, rc = 0;
 
 	for (i = 0; CVIRT[i].db; i++) {
 		char *buf = NULL;
 
+		if (s->cvirt[i] == SAMPLE_UNKNOWN)
+			continue;
+
 		asprintf(&buf,
-			"update %s/%s/%s.rrd %ld:%d",
+			"update %s/%s/%s.rrd %ld:%" PRIu64,
 			datadir,
-			name,
+			s->name,
 			CVIRT[i].db,
-			vrrd_align_time(curtime),
-			CVIRT[i].value);
-
-		strtok_t _st, *st = &_st;
-
-		if (!strtok_init_str(st, buf, " ", 0)) {
-			mem_free(buf);
-			return -1;
-		}
-
-		mem_free(buf);
-
-		int argc    = strtok_count(st);
-		char **argv = mem_alloc((argc + 1) * sizeof(char *));
+			vrrd_align_time(s->cvirt_time),
+			s->cvirt[i]);
 
-		if (!argv) {
-			mem_free(argv);
-			strtok_free(st);
-			return -1;
-		}
-
-		if (strtok_toargv(st, argv) < 1) {
-			strtok_free(st);
-			return -1;
-		}
-
-		if (rrd_update(argc, argv) == -1) {
-			log_error("rrd_update(%s): %s", name, rrd_get_error());
-			rrd_clear_error();
-			return -1;
-		}
+		if (vrrd_update(s->name, buf) == -1)
+			rc = -1;
 	}
 
-	return 0;
+	return rc;
 }
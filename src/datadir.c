@@ -0,0 +1,134 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "datadir.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+#include <lucid/str.h>
+
+static
+int datadir_cmp(const void *a, const void *b)
+{
+	return str_cmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* collect entries of path, keep directories or files ending in suffix */
+static
+int datadir_scan(const char *path, const char *suffix, char ***list)
+{
+	LOG_TRACEME
+
+	DIR *dirp;
+	struct dirent *ditp;
+	char **names = NULL;
+	int n = 0, size = 0;
+
+	if ((dirp = opendir(path)) == NULL) {
+		log_perror("opendir(%s)", path);
+		return -1;
+	}
+
+	while ((ditp = readdir(dirp)) != NULL) {
+		int len = str_len(ditp->d_name);
+
+		/* skips '.', '..' and everything vstatd keeps for itself */
+		if (ditp->d_name[0] == '.')
+			continue;
+
+		if (suffix) {
+			int slen = str_len(suffix);
+
+			if (len <= slen || !str_equal(ditp->d_name + len - slen, suffix))
+				continue;
+		}
+
+		else if (ditp->d_type != DT_DIR) {
+			char *dir = NULL;
+			int skip;
+
+			if (ditp->d_type != DT_UNKNOWN)
+				continue;
+
+			asprintf(&dir, "%s/%s", path, ditp->d_name);
+			skip = !isdir(dir);
+			mem_free(dir);
+
+			if (skip)
+				continue;
+		}
+
+		if (n == size) {
+			char **p = mem_realloc(names, (size ? size * 2 : 32) * sizeof(char *));
+
+			if (!p)
+				break;
+
+			names = p;
+			size  = size ? size * 2 : 32;
+		}
+
+		names[n++] = str_dup(ditp->d_name);
+	}
+
+	closedir(dirp);
+
+	if (n > 0)
+		qsort(names, n, sizeof(char *), datadir_cmp);
+
+	*list = names;
+	return n;
+}
+
+int datadir_guests(const char *datadir, char ***list)
+{
+	LOG_TRACEME
+
+	return datadir_scan(datadir, NULL, list);
+}
+
+int datadir_rrds(const char *datadir, const char *guest, char ***list)
+{
+	LOG_TRACEME
+
+	char *path = NULL;
+	int n;
+
+	asprintf(&path, "%s/%s", datadir, guest);
+	n = datadir_scan(path, ".rrd", list);
+	mem_free(path);
+
+	return n;
+}
+
+void datadir_free(char **list, int n)
+{
+	LOG_TRACEME
+
+	int i;
+
+	for (i = 0; i < n; i++)
+		mem_free(list[i]);
+
+	mem_free(list);
+}
@@ -0,0 +1,26 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_DATADIR_H
+#define _VSTATD_DATADIR_H
+
+/* walk the datadir/<guest>/<metric>.rrd layout, lists are sorted and
+ * must be released with datadir_free */
+int  datadir_guests(const char *datadir, char ***list);
+int  datadir_rrds  (const char *datadir, const char *guest, char ***list);
+void datadir_free  (char **list, int n);
+
+#endif
@@ -0,0 +1,184 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <rrd.h>
+
+#include "cfg.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+
+/* the kernel reports an unlimited total as all ones */
+#define DLIMIT_INFINITY ((uint32_t) ~0U)
+
+static
+struct dlimit_data {
+	char *db;
+} DLIMIT[] = {
+	{ "disk_SPACE" },
+	{ "disk_INODES" },
+	{ NULL }
+};
+
+/* the kernel keeps usage per context and mount point, so this is one
+ * syscall per configured mount instead of a walk of the guest's files */
+int dlimit_fetch(xid_t xid, sample_t *s)
+{
+	LOG_TRACEME
+
+	int i, n = cfg_size(cfg, "dlimits"), found = 0;
+	int space_inf = 0, inodes_inf = 0;
+
+	s->dlimit_time = 0;
+	memset(&s->dlimit, 0, sizeof(s->dlimit));
+
+	for (i = 0; i < n; i++) {
+		const char *mount = cfg_getnstr(cfg, "dlimits", i);
+		dx_limit_t dl;
+
+		if (dx_limit_get(mount, xid, &dl) == -1) {
+			/* no disk limit for this guest on this mount */
+			if (errno != ESRCH && errno != ENOENT)
+				log_perror("dx_limit_get(%s, %d)", mount, xid);
+
+			continue;
+		}
+
+		s->dlimit.space_used  += dl.space_used;
+		s->dlimit.inodes_used += dl.inodes_used;
+
+		if (dl.space_total == DLIMIT_INFINITY)
+			space_inf = 1;
+		else
+			s->dlimit.space_total += dl.space_total;
+
+		if (dl.inodes_total == DLIMIT_INFINITY)
+			inodes_inf = 1;
+		else
+			s->dlimit.inodes_total += dl.inodes_total;
+
+		found++;
+	}
+
+	if (!found)
+		return -1;
+
+	/* an unlimited total is stored as 0 */
+	if (space_inf)
+		s->dlimit.space_total = 0;
+
+	if (inodes_inf)
+		s->dlimit.inodes_total = 0;
+
+	s->dlimit_time = time(NULL);
+	return 0;
+}
+
+static
+int dlimit_rrd_create(char *path)
+{
+	LOG_TRACEME
+
+	char timestr[32];
+	time_t curtime = vrrd_begin();
+
+	char *argv[] = {
+		"create", path, "-b", timestr, "-s", STEP_STR,
+		"DS:used:GAUGE:"  HEARTBEAT ":0:U",
+		"DS:total:GAUGE:" HEARTBEAT ":0:U",
+		RRA_DEFAULT
+	};
+
+	int argc = sizeof(argv) / sizeof(*argv);
+
+	snprintf(timestr, 32, "%ld", curtime - STEP - (curtime % STEP));
+
+	if (mkdirnamep(path, 0700) == -1) {
+		log_perror("mkdirnamep(%s)", path);
+		return -1;
+	}
+
+	if (rrd_create(argc, argv) == -1) {
+		log_error("rrd_create(%s): %s", path, rrd_get_error());
+		rrd_clear_error();
+		return -1;
+	}
+
+	return 0;
+}
+
+int dlimit_rrd_check(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	int i;
+
+	for (i = 0; DLIMIT[i].db; i++) {
+		char *path = NULL;
+
+		asprintf(&path, "%s/%s/%s.rrd", datadir, s->name, DLIMIT[i].db);
+
+		if (!isfile(path) && dlimit_rrd_create(path) == -1) {
+			mem_free(path);
+			return -1;
+		}
+
+		mem_free(path);
+	}
+
+	return 0;
+}
+
+int dlimit_rrd_update(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *buf = NULL;
+
+	asprintf(&buf,
+		"update %s/%s/disk_SPACE.rrd %ld:%" PRIu64 ":%" PRIu64,
+		datadir,
+		s->name,
+		vrrd_align_time(s->dlimit_time),
+		s->dlimit.space_used,
+		s->dlimit.space_total);
+
+	int rc = vrrd_update(s->name, buf);
+
+	buf = NULL;
+
+	asprintf(&buf,
+		"update %s/%s/disk_INODES.rrd %ld:%" PRIu64 ":%" PRIu64,
+		datadir,
+		s->name,
+		vrrd_align_time(s->dlimit_time),
+		s->dlimit.inodes_used,
+		s->dlimit.inodes_total);
+
+	if (vrrd_update(s->name, buf) == -1)
+		rc = -1;
+
+	return rc;
+}
@@ -0,0 +1,649 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <rrd.h>
+
+#include "datadir.h"
+
+/* worker threads only use libc allocation and formatting, lucid's memory
+ * pool is not thread-safe; lucid is used from the main thread only */
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/str.h>
+
+#define EXPORT_MAGIC 0x58545356 /* "VSTX" */
+
+enum {
+	FMT_CSV,
+	FMT_JSON,
+	FMT_BIN,
+};
+
+/* every metric found in datadir, sorted by name */
+typedef struct {
+	char *name;
+	char *guest;
+	int ds_cnt;
+	char **ds;
+	int column;
+} export_metric_t;
+
+typedef struct {
+	char *guest;
+	char **rrds;
+	int nrrds;
+
+	char *buf;
+	size_t len;
+	char *error;
+	int failed;
+	int done;
+} export_job_t;
+
+static const char *datadir = LOCALSTATEDIR "/vstatd";
+static const char *cf = "AVERAGE";
+static time_t start, end;
+static unsigned long resolution = 0;
+static int format = FMT_CSV;
+
+static export_metric_t *metrics = NULL;
+static int nmetrics = 0;
+
+static char **columns = NULL;
+static int ncolumns = 0;
+
+static export_job_t *jobs = NULL;
+static int njobs = 0, next = 0, written = 0, window = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+
+static inline
+void usage(int rc)
+{
+	printf("Usage: vstatd-export [<opts>]\n"
+	       "\n"
+	       "Available options:\n"
+	       "   -D <dir>      data directory (default: %s/vstatd)\n"
+	       "   -c <cf>       consolidation function (default: AVERAGE)\n"
+	       "   -s <secs>     start this many seconds ago (default: 86400)\n"
+	       "   -e <secs>     end this many seconds ago (default: 0)\n"
+	       "   -r <secs>     resolution (default: finest available)\n"
+	       "   -f <format>   csv, json or bin (default: csv)\n"
+	       "   -j <n>        number of fetch threads (default: online CPUs)\n"
+	       "   -d            debug mode\n",
+	       LOCALSTATEDIR);
+	exit(rc);
+}
+
+static
+int export_metric_cmp(const void *a, const void *b)
+{
+	return strcmp(((const export_metric_t *) a)->name,
+	              ((const export_metric_t *) b)->name);
+}
+
+static
+export_metric_t *export_metric(char *rrd)
+{
+	export_metric_t key;
+
+	key.name = rrd;
+
+	return bsearch(&key, metrics, nmetrics, sizeof(export_metric_t),
+	               export_metric_cmp);
+}
+
+static
+int export_fetch(const char *path, time_t *fstart, time_t *fend,
+                 unsigned long *step, unsigned long *ds_cnt,
+                 char ***ds_namv, rrd_value_t **data)
+{
+	*fstart = start;
+	*fend   = end;
+	*step   = resolution;
+
+	return rrd_fetch_r(path, cf, fstart, fend, step, ds_cnt, ds_namv, data);
+}
+
+static
+void export_free(unsigned long ds_cnt, char **ds_namv, rrd_value_t *data)
+{
+	unsigned long i;
+
+	for (i = 0; i < ds_cnt; i++)
+		free(ds_namv[i]);
+
+	free(ds_namv);
+	free(data);
+}
+
+/* the column set is the union of all metrics, the data sources of each
+ * metric are read once from the first file that has it; files of the same
+ * metric with other data sources (e.g. raw and rate schema) are rejected
+ * by export_job instead of ending up in the wrong columns */
+static
+int export_columns(void)
+{
+	int i, j, k;
+
+	for (i = 0; i < njobs; i++) {
+		for (j = 0; j < jobs[i].nrrds; j++) {
+			for (k = 0; k < nmetrics; k++)
+				if (str_equal(metrics[k].name, jobs[i].rrds[j]))
+					break;
+
+			if (k < nmetrics)
+				continue;
+
+			export_metric_t *p = mem_realloc(metrics, (nmetrics + 1) * sizeof(export_metric_t));
+
+			if (!p)
+				log_perror_and_die("mem_realloc");
+
+			metrics = p;
+			metrics[nmetrics].name   = jobs[i].rrds[j];
+			metrics[nmetrics].guest  = jobs[i].guest;
+			metrics[nmetrics].ds_cnt = 0;
+			metrics[nmetrics].ds     = NULL;
+			nmetrics++;
+		}
+	}
+
+	qsort(metrics, nmetrics, sizeof(export_metric_t), export_metric_cmp);
+
+	for (k = 0; k < nmetrics; k++) {
+		char path[4096];
+		time_t fstart, fend;
+		unsigned long step, ds_cnt, d;
+		char **ds_namv;
+		rrd_value_t *data;
+
+		snprintf(path, sizeof(path), "%s/%s/%s",
+		         datadir, metrics[k].guest, metrics[k].name);
+
+		metrics[k].column = ncolumns;
+
+		if (export_fetch(path, &fstart, &fend, &step, &ds_cnt, &ds_namv, &data) == -1) {
+			log_error("rrd_fetch(%s): %s", path, rrd_get_error());
+			rrd_clear_error();
+			continue;
+		}
+
+		char **p = mem_realloc(columns, (ncolumns + ds_cnt) * sizeof(char *));
+
+		if (!p || !(metrics[k].ds = mem_alloc(ds_cnt * sizeof(char *))))
+			log_perror_and_die("mem_alloc");
+
+		columns = p;
+		metrics[k].ds_cnt = ds_cnt;
+
+		for (d = 0; d < ds_cnt; d++) {
+			int len = str_len(metrics[k].name) - 4;
+
+			metrics[k].ds[d]  = str_dup(ds_namv[d]);
+			columns[ncolumns] = mem_alloc(len + str_len(ds_namv[d]) + 2);
+
+			if (!metrics[k].ds[d] || !columns[ncolumns])
+				log_perror_and_die("mem_alloc");
+
+			snprintf(columns[ncolumns], len + str_len(ds_namv[d]) + 2,
+			         "%.*s.%s", len, metrics[k].name, ds_namv[d]);
+			ncolumns++;
+		}
+
+		export_free(ds_cnt, ds_namv, data);
+	}
+
+	return ncolumns;
+}
+
+static
+void export_value(FILE *fp, double v, const char *null)
+{
+	if (isnan(v))
+		fputs(null, fp);
+	else
+		fprintf(fp, "%.10g", v);
+}
+
+/* guest and data source names are not restricted to safe characters */
+static
+void export_json_str(FILE *fp, const char *str)
+{
+	const unsigned char *p;
+
+	fputc('"', fp);
+
+	for (p = (const unsigned char *) str; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			fprintf(fp, "\\%c", *p);
+		else if (*p < 0x20)
+			fprintf(fp, "\\u%04x", *p);
+		else
+			fputc(*p, fp);
+	}
+
+	fputc('"', fp);
+}
+
+static
+void export_format(FILE *fp, export_job_t *job, time_t gstart,
+                   unsigned long step, unsigned long rows, double *matrix)
+{
+	unsigned long r;
+	int c;
+
+	if (format == FMT_BIN) {
+		uint32_t len = strlen(job->guest), n = rows;
+		int64_t t = gstart;
+		uint64_t s = step;
+
+		/* one block per guest in host byte order: name, time grid, then
+		 * one column after the other */
+		fwrite(&len, sizeof(len), 1, fp);
+		fwrite(job->guest, 1, len, fp);
+		fwrite(&n, sizeof(n), 1, fp);
+		fwrite(&t, sizeof(t), 1, fp);
+		fwrite(&s, sizeof(s), 1, fp);
+
+		for (c = 0; c < ncolumns; c++)
+			for (r = 0; r < rows; r++)
+				fwrite(&matrix[r * ncolumns + c], sizeof(double), 1, fp);
+
+		return;
+	}
+
+	for (r = 0; r < rows; r++) {
+		double *row = &matrix[r * ncolumns];
+		long t = gstart + (r + 1) * step;
+
+		if (format == FMT_CSV) {
+			fprintf(fp, "%s,%ld", job->guest, t);
+
+			for (c = 0; c < ncolumns; c++) {
+				fputc(',', fp);
+				export_value(fp, row[c], "");
+			}
+		}
+
+		else {
+			fputs("{\"guest\":", fp);
+			export_json_str(fp, job->guest);
+			fprintf(fp, ",\"time\":%ld", t);
+
+			for (c = 0; c < ncolumns; c++) {
+				fputc(',', fp);
+				export_json_str(fp, columns[c]);
+				fputc(':', fp);
+				export_value(fp, row[c], "null");
+			}
+
+			fputc('}', fp);
+		}
+
+		fputc('\n', fp);
+	}
+}
+
+/* only the first error of a job is reported, the job fails even if there
+ * was no memory left to describe the error */
+static
+void export_error(export_job_t *job, char *error)
+{
+	job->failed = 1;
+
+	if (!job->error)
+		job->error = error;
+	else
+		free(error);
+}
+
+/* columns are assigned by data source name, which only works if every
+ * file of a metric has the same data sources as the first one */
+static
+int export_same_ds(export_metric_t *m, unsigned long ds_cnt, char **ds_namv)
+{
+	unsigned long d;
+
+	if (ds_cnt != (unsigned long) m->ds_cnt)
+		return 0;
+
+	for (d = 0; d < ds_cnt; d++)
+		if (strcmp(m->ds[d], ds_namv[d]) != 0)
+			return 0;
+
+	return 1;
+}
+
+/* fetch all rrds of one guest and merge them into a rows x columns grid */
+static
+void export_job(export_job_t *job)
+{
+	time_t gstart = 0;
+	unsigned long gstep = 0, rows = 0, r;
+	double *matrix = NULL;
+	int i;
+
+	for (i = 0; i < job->nrrds; i++) {
+		export_metric_t *m = export_metric(job->rrds[i]);
+		char path[4096];
+		time_t fstart, fend;
+		unsigned long step, ds_cnt, d;
+		char **ds_namv;
+		rrd_value_t *data;
+
+		if (!m || m->ds_cnt == 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s/%s",
+		         datadir, job->guest, job->rrds[i]);
+
+		if (export_fetch(path, &fstart, &fend, &step, &ds_cnt, &ds_namv, &data) == -1) {
+			export_error(job, strdup(rrd_get_error()));
+			rrd_clear_error();
+			continue;
+		}
+
+		if (!export_same_ds(m, ds_cnt, ds_namv)) {
+			char *error = NULL;
+
+			if (asprintf(&error, "%s has other data sources than %s/%s "
+			             "(mixed schemas?), skipped",
+			             job->rrds[i], m->guest, m->name) != -1)
+				export_error(job, error);
+
+			export_free(ds_cnt, ds_namv, data);
+			continue;
+		}
+
+		/* the first file defines the time grid of the guest */
+		if (!matrix) {
+			gstart = fstart;
+			gstep  = step;
+			rows   = (fend - fstart) / step;
+
+			/* nothing of the guest falls into the requested range */
+			if (rows == 0) {
+				export_free(ds_cnt, ds_namv, data);
+				break;
+			}
+
+			if (!(matrix = malloc(rows * ncolumns * sizeof(double)))) {
+				export_error(job, strdup(strerror(errno)));
+				export_free(ds_cnt, ds_namv, data);
+				return;
+			}
+
+			for (r = 0; r < rows * ncolumns; r++)
+				matrix[r] = NAN;
+		}
+
+		for (r = 0; r < (unsigned long) (fend - fstart) / step; r++) {
+			time_t t = fstart + (r + 1) * step;
+			unsigned long gr;
+
+			if (t <= gstart || (t - gstart) % gstep != 0)
+				continue;
+
+			if ((gr = (t - gstart) / gstep - 1) >= rows)
+				continue;
+
+			for (d = 0; d < ds_cnt; d++)
+				matrix[gr * ncolumns + m->column + d] = data[r * ds_cnt + d];
+		}
+
+		export_free(ds_cnt, ds_namv, data);
+	}
+
+	if (!matrix)
+		return;
+
+	FILE *fp = open_memstream(&job->buf, &job->len);
+
+	if (!fp) {
+		export_error(job, strdup(strerror(errno)));
+		free(matrix);
+		return;
+	}
+
+	export_format(fp, job, gstart, gstep, rows, matrix);
+
+	/* the stream is only flushed here, which may run out of memory */
+	if (ferror(fp) | fclose(fp)) {
+		export_error(job, strdup(strerror(errno)));
+		free(job->buf);
+		job->buf = NULL;
+		job->len = 0;
+	}
+
+	free(matrix);
+}
+
+static
+void *export_worker(void *arg)
+{
+	while (1) {
+		pthread_mutex_lock(&lock);
+
+		/* do not run too far ahead of the writer */
+		while (next < njobs && next >= written + window)
+			pthread_cond_wait(&cond, &lock);
+
+		if (next >= njobs) {
+			pthread_mutex_unlock(&lock);
+			return NULL;
+		}
+
+		export_job_t *job = &jobs[next++];
+
+		pthread_mutex_unlock(&lock);
+
+		export_job(job);
+
+		pthread_mutex_lock(&lock);
+		job->done = 1;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+static
+void export_header(void)
+{
+	int c;
+
+	if (format == FMT_CSV) {
+		fputs("guest,time", stdout);
+
+		for (c = 0; c < ncolumns; c++)
+			printf(",%s", columns[c]);
+
+		fputc('\n', stdout);
+	}
+
+	else if (format == FMT_BIN) {
+		uint32_t magic = EXPORT_MAGIC, n = ncolumns;
+
+		fwrite(&magic, sizeof(magic), 1, stdout);
+		fwrite(&n, sizeof(n), 1, stdout);
+
+		for (c = 0; c < ncolumns; c++) {
+			uint32_t len = strlen(columns[c]);
+
+			fwrite(&len, sizeof(len), 1, stdout);
+			fwrite(columns[c], 1, len, stdout);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, debug = 0, errors = 0, threads = sysconf(_SC_NPROCESSORS_ONLN);
+	long ago_start = 86400, ago_end = 0;
+
+	while ((c = getopt(argc, argv, "D:c:s:e:r:f:j:d")) != -1) {
+		switch (c) {
+		case 'D':
+			datadir = optarg;
+			break;
+
+		case 'c':
+			cf = optarg;
+			break;
+
+		case 's':
+			ago_start = atol(optarg);
+			break;
+
+		case 'e':
+			ago_end = atol(optarg);
+			break;
+
+		case 'r':
+			resolution = atol(optarg);
+			break;
+
+		case 'f':
+			if (str_equal(optarg, "csv"))
+				format = FMT_CSV;
+			else if (str_equal(optarg, "json"))
+				format = FMT_JSON;
+			else if (str_equal(optarg, "bin"))
+				format = FMT_BIN;
+			else
+				usage(EXIT_FAILURE);
+			break;
+
+		case 'j':
+			threads = atoi(optarg);
+			break;
+
+		case 'd':
+			debug = 1;
+			break;
+
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (argc > optind || ago_start <= ago_end)
+		usage(EXIT_FAILURE);
+
+	if (threads < 1)
+		threads = 1;
+
+	atexit(mem_freeall);
+
+	log_options_t log_options = {
+		.log_ident    = argv[0],
+		.log_dest     = LOGD_STDERR,
+		.log_opts     = LOGO_PRIO|LOGO_IDENT,
+		.log_facility = LOG_DAEMON,
+	};
+
+	if (debug)
+		log_options.log_mask = ((1 << (LOGP_TRACE + 1)) - 1);
+
+	log_init(&log_options);
+	atexit(log_close);
+
+	end   = time(NULL) - ago_end;
+	start = time(NULL) - ago_start;
+
+	char **guests;
+	int nguests = datadir_guests(datadir, &guests);
+
+	if (nguests == -1)
+		exit(EXIT_FAILURE);
+
+	if (!(jobs = mem_alloc((nguests + 1) * sizeof(export_job_t))))
+		log_perror_and_die("mem_alloc");
+
+	memset(jobs, 0, (nguests + 1) * sizeof(export_job_t));
+
+	for (i = 0; i < nguests; i++) {
+		jobs[njobs].guest = guests[i];
+		jobs[njobs].nrrds = datadir_rrds(datadir, guests[i], &jobs[njobs].rrds);
+
+		if (jobs[njobs].nrrds > 0)
+			njobs++;
+	}
+
+	if (export_columns() < 1) {
+		log_error("No data found in %s", datadir);
+		exit(EXIT_FAILURE);
+	}
+
+	export_header();
+
+	window = threads * 2;
+
+	pthread_t *tids = mem_alloc(threads * sizeof(pthread_t));
+
+	if (!tids)
+		log_perror_and_die("mem_alloc");
+
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tids[i], NULL, export_worker, NULL) != 0)
+			log_perror_and_die("pthread_create");
+
+	/* write results in guest order as soon as they are complete */
+	for (i = 0; i < njobs; i++) {
+		pthread_mutex_lock(&lock);
+
+		while (!jobs[i].done)
+			pthread_cond_wait(&cond, &lock);
+
+		pthread_mutex_unlock(&lock);
+
+		if (jobs[i].failed) {
+			log_error("%s: %s", jobs[i].guest,
+			          jobs[i].error ? jobs[i].error : "out of memory");
+			free(jobs[i].error);
+			errors++;
+		}
+
+		fwrite(jobs[i].buf, 1, jobs[i].len, stdout);
+		free(jobs[i].buf);
+
+		pthread_mutex_lock(&lock);
+		written++;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+
+	fflush(stdout);
+
+	if (errors > 0)
+		log_error("%d of %d guests failed or are incomplete", errors, njobs);
+
+	exit(errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
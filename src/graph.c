@@ -0,0 +1,387 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <rrd.h>
+
+#include "datadir.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+#include <lucid/str.h>
+
+#define GRAPH_MAXDS 16
+
+/* one graph per archive set of RRA_DEFAULT */
+static
+struct graph_range {
+	char *name;
+	char *start;
+} RANGES[] = {
+	{ "30m", "-1800" },
+	{ "6h",  "-21600" },
+	{ "1d",  "-86400" },
+	{ "30d", "-2592000" },
+	{ "1y",  "-31536000" },
+	{ NULL,  NULL }
+};
+
+static const char *COLORS[] = {
+	"#0000ff", "#00a000", "#ff0000", "#ff8000",
+	"#a000a0", "#00a0a0", "#606060", "#a0a000",
+};
+
+typedef struct {
+	char *guest;
+	char *rrd;
+} graph_job_t;
+
+typedef struct {
+	int rendered;
+	int skipped;
+	int failed;
+} graph_stats_t;
+
+static const char *datadir = LOCALSTATEDIR "/vstatd";
+static const char *outdir  = NULL;
+static int force = 0;
+
+static inline
+void usage(int rc)
+{
+	printf("Usage: vstatd-graph [<opts>] -o <dir>\n"
+	       "\n"
+	       "Available options:\n"
+	       "   -D <dir>      data directory (default: %s/vstatd)\n"
+	       "   -o <dir>      output directory for PNG files\n"
+	       "   -j <n>        number of parallel renderers (default: online CPUs)\n"
+	       "   -f            render even if the cached graph is up to date\n"
+	       "   -d            debug mode\n",
+	       LOCALSTATEDIR);
+	exit(rc);
+}
+
+/* data source names in index order, as reported by rrd_info */
+static
+int graph_ds(char *path, char *ds[GRAPH_MAXDS])
+{
+	LOG_TRACEME
+
+	rrd_info_t *info, *p;
+	int n = 0;
+
+	if ((info = rrd_info_r(path)) == NULL) {
+		log_error("rrd_info(%s): %s", path, rrd_get_error());
+		rrd_clear_error();
+		return -1;
+	}
+
+	for (p = info; p; p = p->next) {
+		char *name, *end;
+		unsigned long idx;
+
+		if (p->type != RD_I_CNT || strncmp(p->key, "ds[", 3) != 0)
+			continue;
+
+		if (!(end = strstr(p->key, "].index")))
+			continue;
+
+		idx = p->value.u_cnt;
+
+		if (idx >= GRAPH_MAXDS)
+			continue;
+
+		name = p->key + 3;
+		ds[idx] = strndup(name, end - name);
+
+		if (idx + 1 > (unsigned long) n)
+			n = idx + 1;
+	}
+
+	rrd_info_free(info);
+	return n;
+}
+
+static
+int graph_one(char *path, char *out, char *title,
+              char *start, char **ds, int nds)
+{
+	LOG_TRACEME
+
+	char *argv[8 + 2 * GRAPH_MAXDS];
+	char *defs[2 * GRAPH_MAXDS];
+	int argc = 0, i, rc = 0;
+
+	argv[argc++] = "graph";
+	argv[argc++] = out;
+	argv[argc++] = "-a";
+	argv[argc++] = "PNG";
+	argv[argc++] = "-s";
+	argv[argc++] = start;
+	argv[argc++] = "-t";
+	argv[argc++] = title;
+
+	for (i = 0; i < nds; i++) {
+		defs[2 * i]     = NULL;
+		defs[2 * i + 1] = NULL;
+
+		asprintf(&defs[2 * i], "DEF:v%d=%s:%s:AVERAGE", i, path, ds[i]);
+		asprintf(&defs[2 * i + 1], "LINE1:v%d%s:%s",
+		         i, COLORS[i % (sizeof(COLORS) / sizeof(*COLORS))], ds[i]);
+
+		argv[argc++] = defs[2 * i];
+		argv[argc++] = defs[2 * i + 1];
+	}
+
+	char **calcpr = NULL;
+	int xsize, ysize;
+	double ymin, ymax;
+
+	if (rrd_graph(argc, argv, &calcpr, &xsize, &ysize, NULL, &ymin, &ymax) == -1) {
+		log_error("rrd_graph(%s): %s", out, rrd_get_error());
+		rrd_clear_error();
+		rc = -1;
+	}
+
+	if (calcpr) {
+		for (i = 0; calcpr[i]; i++)
+			rrd_freemem(calcpr[i]);
+
+		rrd_freemem(calcpr);
+	}
+
+	for (i = 0; i < 2 * nds; i++)
+		mem_free(defs[i]);
+
+	return rc;
+}
+
+static
+int graph_newer(struct stat *a, struct stat *b)
+{
+	if (a->st_mtim.tv_sec != b->st_mtim.tv_sec)
+		return a->st_mtim.tv_sec > b->st_mtim.tv_sec;
+
+	return a->st_mtim.tv_nsec > b->st_mtim.tv_nsec;
+}
+
+/* render all ranges of one rrd, skipping graphs newer than the data */
+static
+void graph_job(graph_job_t *job, graph_stats_t *stats)
+{
+	LOG_TRACEME
+
+	char *path = NULL, *metric = str_dup(job->rrd);
+	char *ds[GRAPH_MAXDS];
+	int nds = -1, i;
+	struct stat sb;
+
+	metric[str_len(metric) - 4] = '\0';
+	asprintf(&path, "%s/%s/%s", datadir, job->guest, job->rrd);
+
+	if (stat(path, &sb) == -1) {
+		log_perror("stat(%s)", path);
+		stats->failed++;
+		goto out;
+	}
+
+	for (i = 0; RANGES[i].name; i++) {
+		char *out = NULL, *title = NULL;
+		struct stat osb;
+
+		asprintf(&out, "%s/%s/%s-%s.png",
+		         outdir, job->guest, metric, RANGES[i].name);
+
+		/* the rrd is written on every update, so its mtime is the time
+		 * of the last update and only graphs rendered after it are
+		 * current; on filesystems with whole second timestamps a graph
+		 * from the same second is rendered again */
+		if (!force && stat(out, &osb) == 0 && graph_newer(&osb, &sb)) {
+			stats->skipped++;
+			mem_free(out);
+			continue;
+		}
+
+		if (nds == -1) {
+			memset(ds, 0, sizeof(ds));
+			nds = graph_ds(path, ds);
+		}
+
+		if (nds < 1 || mkdirnamep(out, 0755) == -1) {
+			stats->failed++;
+			mem_free(out);
+			continue;
+		}
+
+		asprintf(&title, "%s %s (%s)", job->guest, metric, RANGES[i].name);
+
+		if (graph_one(path, out, title, RANGES[i].start, ds, nds) == -1)
+			stats->failed++;
+		else
+			stats->rendered++;
+
+		mem_free(title);
+		mem_free(out);
+	}
+
+	for (i = 0; i < nds; i++)
+		free(ds[i]);
+
+out:
+	mem_free(metric);
+	mem_free(path);
+}
+
+int main(int argc, char **argv)
+{
+	int c, debug = 0, workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "D:o:j:fd")) != -1) {
+		switch (c) {
+		case 'D':
+			datadir = optarg;
+			break;
+
+		case 'o':
+			outdir = optarg;
+			break;
+
+		case 'j':
+			workers = atoi(optarg);
+			break;
+
+		case 'f':
+			force = 1;
+			break;
+
+		case 'd':
+			debug = 1;
+			break;
+
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (argc > optind || !outdir)
+		usage(EXIT_FAILURE);
+
+	if (workers < 1)
+		workers = 1;
+
+	atexit(mem_freeall);
+
+	log_options_t log_options = {
+		.log_ident    = argv[0],
+		.log_dest     = LOGD_STDERR,
+		.log_opts     = LOGO_PRIO|LOGO_IDENT,
+		.log_facility = LOG_DAEMON,
+	};
+
+	if (debug)
+		log_options.log_mask = ((1 << (LOGP_TRACE + 1)) - 1);
+
+	log_init(&log_options);
+	atexit(log_close);
+
+	/* collect all jobs up front so they can be dealt out to the workers */
+	char **guests;
+	int nguests = datadir_guests(datadir, &guests);
+	graph_job_t *jobs = NULL;
+	int njobs = 0, i, j;
+
+	if (nguests == -1)
+		exit(EXIT_FAILURE);
+
+	for (i = 0; i < nguests; i++) {
+		char **rrds;
+		int nrrds = datadir_rrds(datadir, guests[i], &rrds);
+
+		if (nrrds < 1)
+			continue;
+
+		graph_job_t *p = mem_realloc(jobs, (njobs + nrrds) * sizeof(graph_job_t));
+
+		if (!p)
+			log_perror_and_die("mem_realloc");
+
+		jobs = p;
+
+		for (j = 0; j < nrrds; j++) {
+			jobs[njobs].guest = guests[i];
+			jobs[njobs].rrd   = rrds[j];
+			njobs++;
+		}
+
+		mem_free(rrds);
+	}
+
+	/* librrd's graphing code keeps global state and is not reentrant,
+	 * so the pool consists of processes instead of threads */
+	int fds[2];
+
+	if (pipe(fds) == -1)
+		log_perror_and_die("pipe");
+
+	for (i = 0; i < workers && i < njobs; i++) {
+		switch (fork()) {
+		case -1:
+			log_perror_and_die("fork");
+
+		case 0: {
+			graph_stats_t stats = { 0, 0, 0 };
+
+			close(fds[0]);
+
+			for (j = i; j < njobs; j += workers)
+				graph_job(&jobs[j], &stats);
+
+			write(fds[1], &stats, sizeof(stats));
+			_exit(EXIT_SUCCESS);
+		}
+
+		default:
+			break;
+		}
+	}
+
+	close(fds[1]);
+
+	graph_stats_t total = { 0, 0, 0 }, stats;
+
+	while (read(fds[0], &stats, sizeof(stats)) == sizeof(stats)) {
+		total.rendered += stats.rendered;
+		total.skipped  += stats.skipped;
+		total.failed   += stats.failed;
+	}
+
+	while (wait(NULL) > 0);
+
+	log_info("%d graphs rendered, %d up to date, %d failed",
+	         total.rendered, total.skipped, total.failed);
+
+	exit(total.failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,314 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "guest.h"
+#include "rule.h"
+
+#include <lucid/log.h>
+#include <lucid/mem.h>
+
+guest_store_t GUESTS;
+
+/* every column of the store, they are carved out of one arena in this
+ * order */
+#define GUEST_COLUMNS \
+	COLUMN(id) COLUMN(cycle) COLUMN(live) COLUMN(valid) COLUMN(free) \
+	COLUMN(name) COLUMN(cacct_time) COLUMN(inet_recvb) COLUMN(inet_sendb) \
+	COLUMN(bytes) COLUMN(load1) COLUMN(cvirt) COLUMN(limit) \
+	COLUMN(hard) COLUMN(hard_time) COLUMN(written) COLUMN(interval) COLUMN(traffic) COLUMN(rules)
+
+#define COLUMN(c) + sizeof(*GUESTS.c)
+#define GUEST_SLOT_BYTES (0 GUEST_COLUMNS)
+
+typedef char guest_slot_fits[GUEST_SLOT_BYTES <= GUEST_SLOT_MAX ? 1 : -1];
+
+static const size_t slot_bytes = GUEST_SLOT_BYTES;
+
+#define GUEST_CHUNK 1024
+
+static void *arena = NULL;
+
+/* free slots below used, the top of the stack is handed out next */
+static unsigned int nfree = 0;
+
+/* open addressing index from guest id to slot + 1, size is always a power
+ * of two */
+static unsigned int *INDEX = NULL;
+static unsigned int index_size = 0;
+static unsigned int index_used = 0;
+
+/* rule states allocated and the size of each */
+static unsigned int nstates = 0;
+static size_t state_bytes = 0;
+
+static inline
+unsigned int guest_hash(uint64_t id)
+{
+	return (unsigned int) ((id * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static
+void guest_insert(unsigned int *table, unsigned int size, unsigned int slot)
+{
+	unsigned int i = guest_hash(GUESTS.id[slot]) & (size - 1);
+
+	while (table[i])
+		i = (i + 1) & (size - 1);
+
+	table[i] = slot + 1;
+}
+
+static
+int guest_reindex(unsigned int size)
+{
+	LOG_TRACEME
+
+	unsigned int *table = mem_alloc(size * sizeof(unsigned int));
+	unsigned int slot;
+
+	if (!table)
+		return -1;
+
+	memset(table, 0, size * sizeof(unsigned int));
+
+	for (slot = 0; slot < GUESTS.used; slot++)
+		if (GUESTS.live[slot])
+			guest_insert(table, size, slot);
+
+	mem_free(INDEX);
+
+	INDEX      = table;
+	index_size = size;
+
+	return 0;
+}
+
+/* move all columns into an arena for size slots, sizes are multiples of
+ * 64, so every column starts 8-byte aligned */
+static
+int guest_grow(unsigned int size)
+{
+	LOG_TRACEME
+
+	char *p = mem_alloc(size * slot_bytes);
+	guest_store_t old = GUESTS;
+
+	if (!p)
+		return -1;
+
+	memset(p, 0, size * slot_bytes);
+
+#undef  COLUMN
+#define COLUMN(c) \
+	GUESTS.c = (void *) p; \
+	if (old.c) \
+		memcpy(GUESTS.c, old.c, old.used * sizeof(*GUESTS.c)); \
+	p += size * sizeof(*GUESTS.c);
+
+	GUEST_COLUMNS
+
+	mem_free(arena);
+
+	arena       = GUESTS.id;
+	GUESTS.size = size;
+
+	return 0;
+}
+
+/* doubling would leave up to half of a large arena unused, so big hosts
+ * grow in steps of GUEST_CHUNK slots instead */
+static inline
+unsigned int guest_next(unsigned int size)
+{
+	if (size < 64)
+		return 64;
+
+	return size < GUEST_CHUNK ? size * 2 : size + GUEST_CHUNK;
+}
+
+/* slot of a guest, a new one is allocated for unknown ids */
+int guest_get(uint64_t id, unsigned int cycle)
+{
+	LOG_TRACEME
+
+	unsigned int i, slot;
+
+	if (index_size > 0) {
+		i = guest_hash(id) & (index_size - 1);
+
+		for (; INDEX[i]; i = (i + 1) & (index_size - 1)) {
+			slot = INDEX[i] - 1;
+
+			if (GUESTS.id[slot] == id) {
+				GUESTS.cycle[slot] = cycle;
+				return slot;
+			}
+		}
+	}
+
+	/* keep the load factor below 1/2 */
+	if ((index_used + 1) * 2 > index_size &&
+	    guest_reindex(index_size ? index_size * 2 : 128) == -1)
+		return -1;
+
+	if (nfree > 0)
+		slot = GUESTS.free[--nfree];
+
+	else {
+		if (GUESTS.used == GUESTS.size &&
+		    guest_grow(guest_next(GUESTS.size)) == -1)
+			return -1;
+
+		slot = GUESTS.used++;
+	}
+
+	GUESTS.id[slot]        = id;
+	GUESTS.cycle[slot]     = cycle;
+	GUESTS.live[slot]      = 1;
+	GUESTS.valid[slot]     = 0;
+	GUESTS.hard_time[slot] = 0;
+	GUESTS.written[slot]   = 0;
+	GUESTS.interval[slot]  = 0;
+	GUESTS.traffic[slot]   = 0;
+	GUESTS.rules[slot]     = NULL;
+
+	guest_insert(INDEX, index_size, slot);
+	index_used++;
+
+	return slot;
+}
+
+/* keep what later cycles compare against from the sample just written */
+void guest_remember(int g, const sample_t *s)
+{
+	LOG_TRACEME
+
+	uint64_t bytes = 0;
+	int i;
+
+	for (i = 0; i < CACCT_NR; i++)
+		bytes += s->cacct[i].recvb + s->cacct[i].sendb;
+
+	for (i = 0; i < LIMIT_NR; i++) {
+		GUESTS.limit[g][i].cur = s->limit[i].cur;
+		GUESTS.limit[g][i].max = s->limit[i].max;
+	}
+
+	memcpy(GUESTS.name[g],  s->name,  SAMPLE_NAMELEN);
+	memcpy(GUESTS.cvirt[g], s->cvirt, sizeof(GUESTS.cvirt[g]));
+
+	GUESTS.cacct_time[g] = s->cacct_time;
+	GUESTS.inet_recvb[g] = s->cacct[CACCT_INET].recvb;
+	GUESTS.inet_sendb[g] = s->cacct[CACCT_INET].sendb;
+	GUESTS.bytes[g]      = bytes;
+	GUESTS.load1[g]      = s->loadavg[LOADAVG_1MIN];
+	GUESTS.valid[g]      = 1;
+}
+
+/* fill in what a skipped guest was not probed for */
+void guest_recall(int g, sample_t *s)
+{
+	LOG_TRACEME
+
+	int i;
+
+	for (i = 0; i < LIMIT_NR; i++) {
+		s->limit[i].cur = GUESTS.limit[g][i].cur;
+		s->limit[i].max = GUESTS.limit[g][i].max;
+	}
+
+	memcpy(s->limit_hard, GUESTS.hard[g], sizeof(s->limit_hard));
+	memcpy(s->name, GUESTS.name[g], SAMPLE_NAMELEN);
+}
+
+/* states of n rules for a guest, allocated on first use */
+struct rule_state *guest_rules(int g, int n)
+{
+	LOG_TRACEME
+
+	if (GUESTS.rules[g])
+		return GUESTS.rules[g];
+
+	rule_state_t *states = mem_alloc(n * sizeof(rule_state_t));
+
+	if (!states)
+		return NULL;
+
+	memset(states, 0, n * sizeof(rule_state_t));
+
+	GUESTS.rules[g] = states;
+	state_bytes     = n * sizeof(rule_state_t);
+	nstates++;
+
+	return states;
+}
+
+static
+void guest_drop_rules(unsigned int slot)
+{
+	if (!GUESTS.rules[slot])
+		return;
+
+	mem_free(GUESTS.rules[slot]);
+	GUESTS.rules[slot] = NULL;
+	nstates--;
+}
+
+/* rule states are indexed by rule, so they are dropped when the rules
+ * change */
+void guest_forget_rules(void)
+{
+	LOG_TRACEME
+
+	unsigned int slot;
+
+	for (slot = 0; slot < GUESTS.used; slot++)
+		guest_drop_rules(slot);
+}
+
+void guest_sweep(unsigned int cycle)
+{
+	LOG_TRACEME
+
+	unsigned int slot, removed = 0;
+
+	for (slot = 0; slot < GUESTS.used; slot++) {
+		if (GUESTS.live[slot] && GUESTS.cycle[slot] != cycle) {
+			log_debug("guest %" PRIu64 " disappeared", GUESTS.id[slot]);
+			guest_drop_rules(slot);
+			GUESTS.live[slot]  = 0;
+			GUESTS.valid[slot] = 0;
+			GUESTS.free[nfree++] = slot;
+			index_used--;
+			removed++;
+		}
+	}
+
+	/* linear probing does not support holes, so rebuild the index */
+	if (removed > 0)
+		guest_reindex(index_size);
+}
+
+/* bytes held by the store including the rule states */
+size_t guest_footprint(void)
+{
+	return GUESTS.size * slot_bytes +
+	       (size_t) index_size * sizeof(unsigned int) +
+	       nstates * state_bytes;
+}
@@ -0,0 +1,88 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_GUEST_H
+#define _VSTATD_GUEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "sample.h"
+
+struct rule_state;
+
+typedef struct {
+	uint64_t cur;
+	uint64_t max;
+} guest_limit_t;
+
+/* state kept across cycles for every guest we have seen, stored as one
+ * column per field and indexed by a dense slot: a cycle over all guests
+ * walks every column front to back, and the slot of a guest that
+ * disappeared is handed to the next new one.
+ *
+ * only the parts of the last written sample that later cycles look at are
+ * kept, which makes a slot about 550 bytes and 10,000 guests about 5.8MB
+ * including the id index, plus the rule states of guests rules looked at.
+ * GUEST_SLOT_MAX is checked at compile time and vstatd-bench checks the
+ * footprint of 10,000 guests. */
+#define GUEST_SLOT_MAX 640
+
+typedef struct {
+	unsigned int size;
+	unsigned int used;
+
+	uint64_t *id;
+	unsigned int *cycle;
+	unsigned char *live;
+	unsigned char *valid;
+	unsigned int *free;
+
+	/* last written sample */
+	char (*name)[SAMPLE_NAMELEN];
+	time_t *cacct_time;
+	uint64_t *inet_recvb;
+	uint64_t *inet_sendb;
+	uint64_t *bytes;
+	uint64_t *load1;
+	uint64_t (*cvirt)[CVIRT_NR];
+	guest_limit_t (*limit)[LIMIT_NR];
+
+	/* configured limits, see limit_hard */
+	uint64_t (*hard)[LIMIT_NR];
+	time_t *hard_time;
+
+	/* adaptive sampling */
+	time_t *written;
+	int *interval;
+	uint64_t *traffic;
+
+	/* threshold rules, one entry per rule */
+	struct rule_state **rules;
+} guest_store_t;
+
+extern guest_store_t GUESTS;
+
+int    guest_get         (uint64_t id, unsigned int cycle);
+void   guest_remember    (int g, const sample_t *s);
+void   guest_recall      (int g, sample_t *s);
+struct rule_state *guest_rules(int g, int n);
+void   guest_forget_rules(void);
+void   guest_sweep       (unsigned int cycle);
+size_t guest_footprint   (void);
+
+#endif
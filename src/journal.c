@@ -0,0 +1,427 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <endian.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "cfg.h"
+#include "journal.h"
+#include "push.h"
+#include "stage.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+
+static int journal_fd = -1;
+static char *journal_path = NULL;
+
+/* while the persist stage lags behind, the journal is rotated into this
+ * segment, which is removed once the persist stage has passed its mark */
+static char *rotated_path = NULL;
+static uint64_t rotated_mark = 0;
+static int rotated = 0;
+
+/* encoded samples of the group being written */
+static unsigned char *pack = NULL;
+static size_t pack_size = 0;
+
+/* FNV-1a, only used to detect torn writes */
+static
+uint32_t journal_sum(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint32_t sum = 2166136261U;
+
+	while (len--) {
+		sum ^= *p++;
+		sum *= 16777619U;
+	}
+
+	return sum;
+}
+
+/* append one group of samples to fd */
+int journal_append(int fd, sample_t *batch, int count, time_t curtime)
+{
+	LOG_TRACEME
+
+	journal_hdr_t hdr;
+	struct iovec iov[2];
+	unsigned char *p;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		len += push_size(&batch[i]);
+
+	if (len > pack_size) {
+		if (!(p = mem_realloc(pack, len))) {
+			log_perror("mem_realloc");
+			return -1;
+		}
+
+		pack      = p;
+		pack_size = len;
+	}
+
+	for (p = pack, i = 0; i < count; i++)
+		p = push_encode(p, &batch[i]);
+
+	hdr.magic    = htobe32(JOURNAL_MAGIC);
+	hdr.version  = htobe32(JOURNAL_VERSION);
+	hdr.count    = htobe32(count);
+	hdr.len      = htobe32(len);
+	hdr.sum      = htobe32(journal_sum(pack, len));
+	hdr.reserved = 0;
+	hdr.time     = htobe64((uint64_t) (int64_t) curtime);
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len  = sizeof(hdr);
+	iov[1].iov_base = pack;
+	iov[1].iov_len  = len;
+
+	if (writev(fd, iov, 2) != (ssize_t) (sizeof(hdr) + len)) {
+		log_perror("writev");
+		return -1;
+	}
+
+	return 0;
+}
+
+static
+ssize_t journal_readn(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, (char *) buf + done, len - done);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			break;
+
+		done += n;
+	}
+
+	return done;
+}
+
+/* feed every sample of every complete group in fd to cb, returns the
+ * number of samples cb accepted or -1 if fd holds groups of another
+ * version */
+int journal_load(int fd, journal_cb_t cb)
+{
+	LOG_TRACEME
+
+	journal_hdr_t hdr;
+	struct stat sb;
+	sample_t *buf = NULL;
+	unsigned char *raw = NULL;
+	uint32_t size = 0, rawsize = 0, version, count, len, i;
+	off_t offset = 0, end = -1;
+	int samples = 0, failed = 0, torn = 0, incompatible = 0;
+
+	/* count and length are not covered by the checksum, a group can
+	 * never be larger than what is left of the file */
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode))
+		end = sb.st_size - lseek(fd, 0, SEEK_CUR);
+
+	while (journal_readn(fd, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+		if (be32toh(hdr.magic) != JOURNAL_MAGIC) {
+			torn = 1;
+			break;
+		}
+
+		/* version 1 had sizeof(sample_t) in host byte order here */
+		if ((version = be32toh(hdr.version)) != JOURNAL_VERSION) {
+			log_error("Incompatible trace version %u at offset %ld, "
+			          "expected %u", version > 0xffff ? 1 : version,
+			          (long) offset, JOURNAL_VERSION);
+			incompatible = 1;
+			break;
+		}
+
+		count = be32toh(hdr.count);
+		len   = be32toh(hdr.len);
+
+		if (count > len / PUSH_SAMPLE_MIN ||
+		    (end != -1 && len > end - offset - (off_t) sizeof(hdr))) {
+			torn = 1;
+			break;
+		}
+
+		if (len > rawsize) {
+			unsigned char *p = mem_realloc(raw, len);
+
+			if (!p) {
+				log_perror("mem_realloc");
+				torn = 1;
+				break;
+			}
+
+			raw     = p;
+			rawsize = len;
+		}
+
+		if (count > size) {
+			sample_t *p = mem_realloc(buf, count * sizeof(sample_t));
+
+			if (!p) {
+				log_perror("mem_realloc");
+				torn = 1;
+				break;
+			}
+
+			buf  = p;
+			size = count;
+		}
+
+		/* a crash during the last group commit leaves a torn tail */
+		if (journal_readn(fd, raw, len) != (ssize_t) len ||
+		    journal_sum(raw, len) != be32toh(hdr.sum) ||
+		    push_decode(raw, len, buf, count) == -1) {
+			torn = 1;
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (cb(&buf[i]) == -1)
+				failed++;
+			else
+				samples++;
+		}
+
+		offset += sizeof(hdr) + len;
+	}
+
+	if (torn)
+		log_warn("Discarding incomplete group at offset %ld", (long) offset);
+
+	if (failed > 0)
+		log_warn("%d samples could not be stored", failed);
+
+	mem_free(raw);
+	mem_free(buf);
+	return incompatible ? -1 : samples;
+}
+
+/* time of the first group in fd, which is left at its start */
+time_t journal_first(int fd)
+{
+	LOG_TRACEME
+
+	journal_hdr_t hdr;
+	time_t first = 0;
+
+	if (lseek(fd, 0, SEEK_SET) == -1) {
+		log_perror("lseek");
+		return 0;
+	}
+
+	if (journal_readn(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+	    be32toh(hdr.magic) == JOURNAL_MAGIC &&
+	    be32toh(hdr.version) == JOURNAL_VERSION)
+		first = (time_t) (int64_t) be64toh(hdr.time);
+
+	if (lseek(fd, 0, SEEK_SET) == -1)
+		log_perror("lseek");
+
+	return first;
+}
+
+int journal_init(void)
+{
+	LOG_TRACEME
+
+	/* called again on reload, once everything journaled is persisted */
+	if (journal_fd != -1) {
+		close(journal_fd);
+		journal_fd = -1;
+	}
+
+	mem_free(journal_path);
+	mem_free(rotated_path);
+
+	journal_path = rotated_path = NULL;
+	rotated = 0;
+
+	if (!cfg_getbool(cfg, "journal"))
+		return 0;
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+
+	asprintf(&journal_path, "%s/journal",   datadir);
+	asprintf(&rotated_path, "%s/journal.1", datadir);
+
+	journal_fd = open(journal_path, O_RDWR|O_CREAT|O_APPEND, 0600);
+
+	if (journal_fd == -1) {
+		log_perror("open(%s)", journal_path);
+		return -1;
+	}
+
+	/* left over from a crash while the persist stage was behind */
+	rotated = isfile(rotated_path);
+
+	return 0;
+}
+
+/* append all samples of one cycle and sync them in a single group commit */
+int journal_write(sample_t *batch, int count, time_t curtime)
+{
+	LOG_TRACEME
+
+	if (journal_fd == -1 || count < 1)
+		return 0;
+
+	if (journal_append(journal_fd, batch, count, curtime) == -1)
+		return -1;
+
+	if (fdatasync(journal_fd) == -1) {
+		log_perror("fdatasync(journal)");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* everything in the journal has been persisted */
+int journal_clear(void)
+{
+	LOG_TRACEME
+
+	if (journal_fd == -1)
+		return 0;
+
+	if (rotated) {
+		if (unlink(rotated_path) == -1 && errno != ENOENT) {
+			log_perror("unlink(%s)", rotated_path);
+			return -1;
+		}
+
+		rotated = 0;
+	}
+
+	if (ftruncate(journal_fd, 0) == -1) {
+		log_perror("ftruncate(journal)");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* drop what the persist stage has stored. While it lags behind, the
+ * journal is rotated and the previous segment removed once everything in
+ * it is persisted, so the journal stays within about twice the backlog
+ * instead of growing for as long as the backlog lasts */
+int journal_trim(void)
+{
+	LOG_TRACEME
+
+	int fd;
+
+	if (journal_fd == -1)
+		return 0;
+
+	if (stage_persisted(stage_mark()))
+		return journal_clear();
+
+	if (rotated) {
+		if (!stage_persisted(rotated_mark))
+			return 0;
+
+		if (unlink(rotated_path) == -1 && errno != ENOENT) {
+			log_perror("unlink(%s)", rotated_path);
+			return -1;
+		}
+
+		rotated = 0;
+	}
+
+	/* everything journaled so far becomes the previous segment */
+	if (rename(journal_path, rotated_path) == -1) {
+		log_perror("rename(%s)", journal_path);
+		return -1;
+	}
+
+	if ((fd = open(journal_path, O_RDWR|O_CREAT|O_APPEND, 0600)) == -1) {
+		log_perror("open(%s)", journal_path);
+		rename(rotated_path, journal_path);
+		return -1;
+	}
+
+	close(journal_fd);
+
+	journal_fd   = fd;
+	rotated      = 1;
+	rotated_mark = stage_mark();
+
+	return 0;
+}
+
+int journal_replay(void)
+{
+	LOG_TRACEME
+
+	if (journal_fd == -1)
+		return 0;
+
+	/* the rotated segment holds the older samples */
+	int fd = rotated ? open(rotated_path, O_RDONLY) : -1;
+	int samples = 0, n;
+	time_t first;
+
+	if (rotated && fd == -1)
+		log_perror("open(%s)", rotated_path);
+
+	/* files of guests first seen in the journal have to start before
+	 * its oldest sample, and samples persisted before the crash are
+	 * skipped instead of failing */
+	vrrd_replay = journal_first(journal_fd);
+
+	if (fd != -1 && (first = journal_first(fd)) != 0)
+		vrrd_replay = first;
+
+	/* groups an older version left behind cannot be read any more */
+	if (fd != -1) {
+		if ((n = journal_load(fd, vrrd_store)) > 0)
+			samples += n;
+
+		close(fd);
+	}
+
+	if ((n = journal_load(journal_fd, vrrd_store)) > 0)
+		samples += n;
+
+	vrrd_replay = 0;
+
+	if (samples > 0)
+		log_info("Replayed %d samples from journal", samples);
+
+	return journal_clear();
+}
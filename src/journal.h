@@ -0,0 +1,55 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_JOURNAL_H
+#define _VSTATD_JOURNAL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sample.h"
+
+#define JOURNAL_MAGIC   0x5654534a /* "VTSJ" */
+#define JOURNAL_VERSION 2
+
+/* every group starts with this header, followed by len bytes holding
+ * count samples in the encoding push.c sends; the same framing is used
+ * for the journal and for recorded traces, so a trace can be replayed by
+ * any later version on any host. All fields are big-endian, groups of
+ * version 1 were raw sample_t dumps in host byte order */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t len;
+	uint32_t sum;
+	uint32_t reserved;
+	int64_t  time;
+} journal_hdr_t;
+
+typedef int (*journal_cb_t)(sample_t *s);
+
+int    journal_append(int fd, sample_t *batch, int count, time_t curtime);
+int    journal_load  (int fd, journal_cb_t cb);
+time_t journal_first (int fd);
+
+int    journal_init  (void);
+int    journal_write (sample_t *batch, int count, time_t curtime);
+int    journal_clear (void);
+int    journal_trim  (void);
+int    journal_replay(void);
+
+#endif
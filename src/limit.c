@@ -16,10 +16,14 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 
 #include <inttypes.h>
+#include <string.h>
 #include <rrd.h>
 #include <sys/resource.h>
 
 #include "cfg.h"
+#include "cgroup.h"
+#include "guest.h"
+#include "rate.h"
 #include "vrrd.h"
 
 #define _LUCID_PRINTF_MACROS
@@ -27,38 +31,38 @@
 #include <lucid/mem.h>
 #include <lucid/misc.h>
 #include <lucid/printf.h>
-#include <lucid/strtok.h>
 
 static
 struct limit_data {
 	int id;
 	char *db;
-	uint64_t min, cur, max;
 } LIMIT[] = {
-	{ RLIMIT_AS,       "mem_AS",       0, 0, 0 },
-	{ RLIMIT_LOCKS,    "file_LOCKS",   0, 0, 0 },
-	{ RLIMIT_MEMLOCK,  "mem_MEMLOCK",  0, 0, 0 },
-	{ RLIMIT_MSGQUEUE, "ipc_MSGQUEUE", 0, 0, 0 },
-	{ RLIMIT_NOFILE,   "file_NOFILE",  0, 0, 0 },
-	{ RLIMIT_NPROC,    "sys_NPROC",    0, 0, 0 },
-	{ RLIMIT_RSS,      "mem_RSS",      0, 0, 0 },
-	{ VLIMIT_ANON,     "mem_ANON",     0, 0, 0 },
-	{ VLIMIT_DENTRY,   "file_DENTRY",  0, 0, 0 },
-	{ VLIMIT_MAPPED,   "sys_MAPPED",   0, 0, 0 },
-	{ VLIMIT_NSEMS,    "ipc_NSEMS",    0, 0, 0 },
-	{ VLIMIT_NSOCK,    "file_NSOCK",   0, 0, 0 },
-	{ VLIMIT_OPENFD,   "file_OPENFD",  0, 0, 0 },
-	{ VLIMIT_SEMARY,   "ipc_SEMARY",   0, 0, 0 },
-	{ VLIMIT_SHMEM,    "ipc_SHMEM",    0, 0, 0 },
-	{ 0,               NULL,           0, 0, 0 }
+	{ RLIMIT_AS,       "mem_AS" },
+	{ RLIMIT_LOCKS,    "file_LOCKS" },
+	{ RLIMIT_MEMLOCK,  "mem_MEMLOCK" },
+	{ RLIMIT_MSGQUEUE, "ipc_MSGQUEUE" },
+	{ RLIMIT_NOFILE,   "file_NOFILE" },
+	{ RLIMIT_NPROC,    "sys_NPROC" },
+	{ RLIMIT_RSS,      "mem_RSS" },
+	{ VLIMIT_ANON,     "mem_ANON" },
+	{ VLIMIT_DENTRY,   "file_DENTRY" },
+	{ VLIMIT_MAPPED,   "sys_MAPPED" },
+	{ VLIMIT_NSEMS,    "ipc_NSEMS" },
+	{ VLIMIT_NSOCK,    "file_NSOCK" },
+	{ VLIMIT_OPENFD,   "file_OPENFD" },
+	{ VLIMIT_SEMARY,   "ipc_SEMARY" },
+	{ VLIMIT_SHMEM,    "ipc_SHMEM" },
+	{ 0,               NULL }
 };
 
-int limit_fetch(xid_t xid, time_t *curtime)
+/* seconds the configured limits of a guest are cached */
+#define LIMIT_REFRESH 300
+
+int limit_fetch(xid_t xid, sample_t *s)
 {
 	LOG_TRACEME
 
-	if (curtime)
-		*curtime = time(NULL);
+	s->limit_time = time(NULL);
 
 	if (vx_limit_reset(xid) == -1)
 		log_pwarn("vx_reset_rlimit(%d)", xid);
@@ -75,21 +79,75 @@ int limit_fetch(xid_t xid, time_t *curtime)
 			return -1;
 		}
 
-		LIMIT[i].min = sb.minimum;
-		LIMIT[i].cur = sb.value;
-		LIMIT[i].max = sb.maximum;
+		s->limit[i].min = sb.minimum;
+		s->limit[i].cur = sb.value;
+		s->limit[i].max = sb.maximum;
 	}
 
 	return 0;
 }
 
+/* hard limit set for one limit of a context, 0 if unlimited; the
+ * maximum of a sample is only the watermark of the interval. Failures are
+ * left to the caller to report */
+static
+int limit_configured(xid_t xid, int i, uint64_t *max)
+{
+	LOG_TRACEME
+
+	vx_limit_t lim;
+
+	lim.id = LIMIT[i].id;
+
+	if (vx_limit_get(xid, &lim) == -1)
+		return -1;
+
+	*max = lim.maximum == UINT64_MAX ? 0 : lim.maximum;
+	return 0;
+}
+
+/* configured limits of the guest in slot g into s. They rarely change, so
+ * the vserver ones are only read when the slot is new and then every
+ * LIMIT_REFRESH seconds, and a guest they cannot be read for is only
+ * reported once; the cgroup backend samples them as max */
+void limit_hard(int g, sample_t *s)
+{
+	LOG_TRACEME
+
+	uint64_t *hard = GUESTS.hard[g];
+	int i;
+
+	if (cgroup_enabled()) {
+		for (i = 0; i < LIMIT_NR; i++)
+			hard[i] = s->limit[i].max;
+	}
+
+	else if (s->limit_time - GUESTS.hard_time[g] >= LIMIT_REFRESH) {
+		for (i = 0; LIMIT[i].db; i++)
+			if (limit_configured(s->id, i, &hard[i]) == -1)
+				break;
+
+		if (LIMIT[i].db) {
+			if (!GUESTS.hard_time[g])
+				log_pwarn("vx_limit_get(%" PRIu64 ")", s->id);
+
+			for (i = 0; i < LIMIT_NR; i++)
+				hard[i] = SAMPLE_UNKNOWN;
+		}
+
+		GUESTS.hard_time[g] = s->limit_time;
+	}
+
+	memcpy(s->limit_hard, hard, sizeof(s->limit_hard));
+}
+
 static
-int limit_rrd_create(char *path)
+int limit_rrd_create(char *path, int schema)
 {
 	LOG_TRACEME
 
 	char timestr[32];
-	time_t curtime = time(NULL);
+	time_t curtime = vrrd_begin();
 
 	char *argv[] = {
 		"create", path, "-b", timestr, "-s", STEP_STR,
@@ -97,9 +155,15 @@ int limit_rrd_create(char *path)
 		"DS:cur:GAUGE:" HEARTBEAT ":0:18446744073709551615",
 		"DS:max:GAUGE:" HEARTBEAT ":0:18446744073709551615",
 		RRA_DEFAULT
+		NULL
 	};
 
-	int argc = sizeof(argv) / sizeof(*argv);
+	int argc = sizeof(argv) / sizeof(*argv) - 1;
+
+	/* utilization in percent of the configured limit, unknown for
+	 * unlimited ones */
+	if (schema == SCHEMA_RATE)
+		argv[argc++] = "DS:util:GAUGE:" HEARTBEAT ":0:100";
 
 	snprintf(timestr, 32, "%ld", curtime - STEP - (curtime % STEP));
 
@@ -117,7 +181,7 @@ int limit_rrd_create(char *path)
 	return 0;
 }
 
-int limit_rrd_check(char *name)
+int limit_rrd_check(sample_t *s)
 {
 	LOG_TRACEME
 
@@ -127,9 +191,12 @@ int limit_rrd_check(char *name)
 	for (i = 0; LIMIT[i].db; i++) {
 		char *path = NULL;
 
-		asprintf(&path, "%s/%s/%s.rrd", datadir, name, LIMIT[i].db);
+		if (s->limit[i].cur == SAMPLE_UNKNOWN)
+			continue;
 
-		if (!isfile(path) && limit_rrd_create(path) == -1) {
+		asprintf(&path, "%s/%s/%s.rrd", datadir, s->name, LIMIT[i].db);
+
+		if (!isfile(path) && limit_rrd_create(path, rate_create_schema()) == -1) {
 			mem_free(path);
 			return -1;
 		}
@@ -140,55 +207,50 @@ int limit_rrd_check(char *name)
 	return 0;
 }
 
-int limit_rrd_update(char *name, time_t curtime)
+int limit_rrd_update(sample_t *s)
 {
 	LOG_TRACEME
 
 	const char *datadir = cfg_getstr(cfg, "datadir");
-	int i;
+	rate_t *r = rate_get(s->name);
+	int i, rc = 0;
+
+	if (!r)
+		return -1;
 
 	for (i = 0; LIMIT[i].db; i++) {
-		char *buf = NULL;
+		char *path = NULL, *buf = NULL, util[RATE_BUFLEN + 1] = "";
+		char max[RATE_BUFLEN] = "U";
 
-		asprintf(&buf,
-			"update %s/%s/%s.rrd %ld:%" PRIu64 ":%" PRIu64 ":%" PRIu64,
-			datadir,
-			name,
-			LIMIT[i].db,
-			vrrd_align_time(curtime),
-			LIMIT[i].min,
-			LIMIT[i].cur,
-			LIMIT[i].max);
-
-		strtok_t _st, *st = &_st;
-
-		if (!strtok_init_str(st, buf, " ", 0)) {
-			mem_free(buf);
-			return -1;
-		}
+		if (s->limit[i].cur == SAMPLE_UNKNOWN)
+			continue;
 
-		mem_free(buf);
+		/* a cgroup whose limit file could not be read */
+		if (s->limit[i].max != SAMPLE_UNKNOWN)
+			snprintf(max, sizeof(max), "%" PRIu64, s->limit[i].max);
 
-		int argc    = strtok_count(st);
-		char **argv = mem_alloc((argc + 1) * sizeof(char *));
+		asprintf(&path, "%s/%s/%s.rrd", datadir, s->name, LIMIT[i].db);
 
-		if (!argv) {
-			mem_free(argv);
-			strtok_free(st);
-			return -1;
+		if (rate_schema(path, "util", &r->limit_schema[i]) == SCHEMA_RATE) {
+			util[0] = ':';
+			rate_fmt(util + 1, s->limit_hard[i] != SAMPLE_UNKNOWN,
+			         s->limit[i].cur, s->limit_hard[i], 100);
 		}
 
-		if (strtok_toargv(st, argv) < 1) {
-			strtok_free(st);
-			return -1;
-		}
+		asprintf(&buf,
+			"update %s %ld:%" PRIu64 ":%" PRIu64 ":%s%s",
+			path,
+			vrrd_align_time(s->limit_time),
+			s->limit[i].min,
+			s->limit[i].cur,
+			max,
+			util);
 
-		if (rrd_update(argc, argv) == -1) {
-			log_error("rrd_update(%s): %s", name, rrd_get_error());
-			rrd_clear_error();
-			return -1;
-		}
+		mem_free(path);
+
+		if (vrrd_update(s->name, buf) == -1)
+			rc = -1;
 	}
 
-	return 0;
+	return rc;
 }
@@ -26,16 +26,12 @@
 #include <lucid/mem.h>
 #include <lucid/misc.h>
 #include <lucid/printf.h>
-#include <lucid/strtok.h>
 
-static uint32_t LOADAVG[3];
-
-int loadavg_fetch(xid_t xid, time_t *curtime)
+int loadavg_fetch(xid_t xid, sample_t *s)
 {
 	LOG_TRACEME
 
-	if (curtime)
-		*curtime = time(NULL);
+	s->loadavg_time = time(NULL);
 
 	vx_stat_t sb;
 
@@ -44,9 +40,9 @@ int loadavg_fetch(xid_t xid, time_t *curtime)
 		return -1;
 	}
 
-	LOADAVG[0] = sb.load[0];
-	LOADAVG[1] = sb.load[1];
-	LOADAVG[2] = sb.load[2];
+	s->loadavg[LOADAVG_1MIN]  = sb.load[0];
+	s->loadavg[LOADAVG_5MIN]  = sb.load[1];
+	s->loadavg[LOADAVG_15MIN] = sb.load[2];
 
 	return 0;
 }
@@ -57,7 +53,7 @@ int loadavg_rrd_create(char *path)
 	LOG_TRACEME
 
 	char timestr[32];
-	time_t curtime = time(NULL);
+	time_t curtime = vrrd_begin();
 
 	char *argv[] = {
 		"create", path, "-b", timestr, "-s", STEP_STR,
@@ -85,14 +81,14 @@ int loadavg_rrd_create(char *path)
 	return 0;
 }
 
-int loadavg_rrd_check(char *name)
+int loadavg_rrd_check(sample_t *s)
 {
 	LOG_TRACEME
 
 	const char *datadir = cfg_getstr(cfg, "datadir");;
 	char *path = NULL;
 
-	asprintf(&path, "%s/%s/sys_LOADAVG.rrd", datadir, name);
+	asprintf(&path, "%s/%s/sys_LOADAVG.rrd", datadir, s->name);
 
 	if (!isfile(path) && loadavg_rrd_create(path) == -1) {
 		mem_free(path);
@@ -104,7 +100,7 @@ int loadavg_rrd_check(char *name)
 	return 0;
 }
 
-int loadavg_rrd_update(char *name, time_t curtime)
+int loadavg_rrd_update(sample_t *s)
 {
 	LOG_TRACEME
 
@@ -112,42 +108,16 @@ int loadavg_rrd_update(char *name, time_t curtime)
 	char *buf = NULL;
 
 	asprintf(&buf,
-		"update %s/%s/sys_LOADAVG.rrd %ld:%" PRIu32 ":%" PRIu32 ":%" PRIu32,
+		"update %s/%s/sys_LOADAVG.rrd %ld:%" PRIu64 ":%" PRIu64 ":%" PRIu64,
 		datadir,
-		name,
-		vrrd_align_time(curtime),
-		LOADAVG[0],
-		LOADAVG[1],
-		LOADAVG[2]);
-
-	strtok_t _st, *st = &_st;
-
-	if (!strtok_init_str(st, buf, " ", 0)) {
-		mem_free(buf);
-		return -1;
-	}
-
-	mem_free(buf);
+		s->name,
+		vrrd_align_time(s->loadavg_time),
+		s->loadavg[LOADAVG_1MIN],
+		s->loadavg[LOADAVG_5MIN],
+		s->loadavg[LOADAVG_15MIN]);
 
-	int argc    = strtok_count(st);
-	char **argv = mem_alloc((argc + 1) * sizeof(char *));
-
-	if (!argv) {
-		mem_free(argv);
-		strtok_free(st);
+	if (vrrd_update(s->name, buf) == -1)
 		return -1;
-	}
-
-	if (strtok_toargv(st, argv) < 1) {
-		strtok_free(st);
-		return -1;
-	}
-
-	if (rrd_update(argc, argv) == -1) {
-		log_error("rrd_update(%s): %s", name, rrd_get_error());
-		rrd_clear_error();
-		return -1;
-	}
 
 	return 0;
 }
@@ -25,7 +25,19 @@
 #include <syslog.h>
 #include <sys/stat.h>
 
+#include "adapt.h"
+#include "archive.h"
+#include "burst.h"
 #include "cfg.h"
+#include "cgroup.h"
+#include "guest.h"
+#include "journal.h"
+#include "procfs.h"
+#include "push.h"
+#include "rate.h"
+#include "rule.h"
+#include "stage.h"
+#include "topk.h"
 #include "vrrd.h"
 
 #define _LUCID_PRINTF_MACROS
@@ -42,11 +54,68 @@ static cfg_opt_t CFG_OPTS[] = {
 	CFG_STR("pidfile", NULL, CFGF_NONE),
 
 	CFG_STR_CB("datadir", LOCALSTATEDIR "/vstatd", CFGF_NONE, &cfg_validate_path),
+
+	CFG_STR("schema", "raw", CFGF_NONE),
+
+	CFG_STR("topkfile", NULL, CFGF_NONE),
+	CFG_INT("topk",     10,   CFGF_NONE),
+
+	CFG_BOOL("adaptive",           cfg_false, CFGF_NONE),
+	CFG_INT("adaptive_threshold",  20,        CFGF_NONE),
+
+	CFG_BOOL("journal", cfg_true, CFGF_NONE),
+
+	CFG_STR("push",       NULL, CFGF_NONE),
+	CFG_INT("push_queue", 64,   CFGF_NONE),
+	CFG_STR("push_host",  NULL, CFGF_NONE),
+
+	CFG_STR_LIST("dlimits", "{}", CFGF_NONE),
+
+	CFG_STR("backend",      "vserver",        CFGF_NONE),
+	CFG_STR("cgroup_root",  "/sys/fs/cgroup", CFGF_NONE),
+	CFG_STR_LIST("cgroups", "{machine.slice}", CFGF_NONE),
+
+	CFG_BOOL("procfs", cfg_false,       CFGF_NONE),
+	CFG_STR("procdir", "/proc/virtual", CFGF_NONE),
+
+	CFG_STR("alert_fifo", NULL, CFGF_NONE),
+	CFG_STR("alert_exec", NULL, CFGF_NONE),
+	CFG_SEC("rule", RULE_OPTS, CFGF_MULTI|CFGF_TITLE),
+
+	CFG_BOOL("pipeline",    cfg_false, CFGF_NONE),
+	CFG_INT("pipeline_ring", 1024,     CFGF_NONE),
+
+	CFG_INT("burst", 0, CFGF_NONE),
+
+	CFG_INT("archive_days",   0,         CFGF_NONE),
+	CFG_STR("archive_policy", "archive", CFGF_NONE),
+	CFG_INT("archive_batch",  16,        CFGF_NONE),
 	CFG_END()
 };
 
 cfg_t *cfg;
 
+static char *cfg_file = SYSCONFDIR "/vstatd.conf";
+
+/* set by SIGHUP, the configuration is reloaded between two cycles */
+static volatile sig_atomic_t reload = 0;
+
+static log_options_t log_options = {
+	.log_dest     = LOGD_SYSLOG,
+	.log_opts     = LOGO_PRIO|LOGO_TIME|LOGO_IDENT|LOGO_PID,
+	.log_facility = LOG_DAEMON,
+	.log_fd       = -1,
+};
+
+static unsigned int cycle = 0;
+
+/* samples fetched in the current cycle, persisted after the walk */
+static sample_t *batch = NULL;
+static int batch_len = 0, batch_size = 0;
+
+/* trace file every cycle is recorded to (-R) */
+static int record_fd = -1;
+
 static inline
 void usage (int rc)
 {
@@ -54,30 +123,35 @@ void usage (int rc)
 	       "\n"
 	       "Available options:\n"
 	       "   -c <file>     configuration file (default: %s/vstatd.conf)\n"
-	       "   -d            debug mode (do not fork to background)\n",
+	       "   -d            debug mode (do not fork to background)\n"
+	       "   -R <file>     record all fetched samples to <file>\n"
+	       "   -P <file>     replay samples recorded with -R and exit\n"
+	       "   -L <addr>     receive samples pushed by other daemons on <addr>\n"
+	       "   -U <archive>  restore a guest archived by datadir maintenance and exit\n",
 	       SYSCONFDIR);
 	exit(rc);
 }
 
+/* guests found in procdir this cycle, fetched in one go with procfs */
+static sample_t *snap = NULL;
+static int snap_len = 0, snap_size = 0;
+
 static
-void handle_xid(xid_t xid)
+int guest_name(xid_t xid, sample_t *s)
 {
 	LOG_TRACEME
 
-	time_t cacct_time, cvirt_time, limit_time, loadavg_time;
-
-	if (cacct_fetch(xid, &cacct_time) == -1 ||
-	    cvirt_fetch(xid, &cvirt_time) == -1 ||
-	    limit_fetch(xid, &limit_time) == -1 ||
-	    loadavg_fetch(xid, &loadavg_time) == -1)
-		return;
-
 	vx_uname_t uname;
 	uname.id = VHIN_CONTEXT;
 
 	if (vx_uname_get(xid, &uname) == -1) {
-		log_perror("vx_uname_get(%d)", xid);
-		return;
+		/* a procdir fixture on a kernel without vserver support */
+		if (errno != ENOSYS) {
+			log_perror("vx_uname_get(%d)", xid);
+			return -1;
+		}
+
+		snprintf(uname.value, sizeof(uname.value), "%d", xid);
 	}
 
 	char *name = uname.value;
@@ -86,46 +160,363 @@ void handle_xid(xid_t xid)
 	if (p)
 		*p = '\0';
 
-	if (cacct_rrd_check(name) == -1 ||
-	    cvirt_rrd_check(name) == -1 ||
-	    limit_rrd_check(name) == -1 ||
-	    loadavg_rrd_check(name) == -1)
+	snprintf(s->name, SAMPLE_NAMELEN, "%s", name);
+	return 0;
+}
+
+static
+void handle_sample(sample_t *s, int have_limit)
+{
+	LOG_TRACEME
+
+	xid_t xid = s->id;
+	int g = guest_get(s->id, cycle);
+
+	if (g == -1)
+		return;
+
+	burst_mark(xid, cycle);
+
+	/* stable guests are only probed until they change or are due */
+	if (!adapt_due(g, s)) {
+		guest_recall(g, s);
+		topk_add(s, g);
+		rule_eval(g, s);
 		return;
+	}
 
-	if (cacct_rrd_update(name, cacct_time) == -1 ||
-	    cvirt_rrd_update(name, cvirt_time) == -1 ||
-	    limit_rrd_update(name, limit_time) == -1 ||
-	    loadavg_rrd_update(name, loadavg_time) == -1)
+	if (!have_limit && limit_fetch(xid, s) == -1)
 		return;
+
+	limit_hard(g, s);
+
+	/* disk usage changes slowly, so it is only read for written samples */
+	if (!cgroup_enabled())
+		dlimit_fetch(xid, s);
+
+	/* backends without vserver contexts name their guests themselves, the
+	 * others are looked up once per context */
+	if (!s->name[0] && GUESTS.valid[g])
+		memcpy(s->name, GUESTS.name[g], SAMPLE_NAMELEN);
+
+	if (!s->name[0] && guest_name(xid, s) == -1)
+		return;
+
+	/* sub-step samples pile up until the guest is written again */
+	burst_fold(s);
+
+	topk_add(s, GUESTS.valid[g] ? g : -1);
+	rule_eval(g, s);
+	adapt_written(g, s);
+	guest_remember(g, s);
+
+	if (batch_len == batch_size) {
+		int size = batch_size ? batch_size * 2 : 64;
+		sample_t *p = mem_realloc(batch, size * sizeof(sample_t));
+
+		if (!p) {
+			log_perror("mem_realloc");
+			return;
+		}
+
+		batch      = p;
+		batch_size = size;
+	}
+
+	batch[batch_len++] = *s;
 }
 
 static
-void read_proc(void)
+void handle_xid(xid_t xid)
+{
+	LOG_TRACEME
+
+	sample_t s;
+
+	memset(&s, 0, sizeof(s));
+	s.id = xid;
+
+	if (cacct_fetch(xid, &s) == -1 ||
+	    cvirt_fetch(xid, &s) == -1 ||
+	    loadavg_fetch(xid, &s) == -1)
+		return;
+
+	/* optional, kernels without it simply lack the sched_* family */
+	sched_fetch(xid, &s);
+
+	handle_sample(&s, 0);
+}
+
+static
+void queue_xid(xid_t xid)
+{
+	LOG_TRACEME
+
+	if (snap_len == snap_size) {
+		int size = snap_size ? snap_size * 2 : 64;
+		sample_t *p = mem_realloc(snap, size * sizeof(sample_t));
+
+		if (!p) {
+			log_perror("mem_realloc");
+			return;
+		}
+
+		snap      = p;
+		snap_size = size;
+	}
+
+	memset(&snap[snap_len], 0, sizeof(sample_t));
+	snap[snap_len++].id = xid;
+}
+
+static
+void handle_cgroup(sample_t *s)
+{
+	LOG_TRACEME
+	handle_sample(s, 1);
+}
+
+static
+void walk_proc(void)
 {
 	LOG_TRACEME
 
 	DIR *dirp;
+	const char *procdir = cfg_getstr(cfg, "procdir");
 
-	if ((dirp = opendir("/proc/virtual")) == NULL) {
-		log_perror("opendir(/proc/virtual)");
+	if ((dirp = opendir(procdir)) == NULL) {
+		log_perror("opendir(%s)", procdir);
 		return;
 	}
 
 	struct dirent *ditp;
 	xid_t xid = -1;
+	int i;
 
 	while ((ditp = readdir(dirp)) != NULL) {
 		if (!str_isdigit(ditp->d_name))
 			continue;
 
 		sscanf(ditp->d_name, "%" SCNu32, &xid);
-		handle_xid(xid);
+
+		if (procfs_enabled())
+			queue_xid(xid);
+		else
+			handle_xid(xid);
 	}
 
 	closedir(dirp);
+
+	/* all guests' files are read in batches before any is looked at */
+	if (procfs_enabled()) {
+		procfs_fetch(snap, snap_len);
+
+		for (i = 0; i < snap_len; i++)
+			if (procfs_complete(&snap[i]))
+				handle_sample(&snap[i], 1);
+	}
+}
+
+static
+void read_proc(void)
+{
+	LOG_TRACEME
+
+	time_t curtime = time(NULL);
+	struct timespec start, stop;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	cycle++;
+	batch_len = 0;
+	snap_len  = 0;
+	topk_reset();
+
+	if (cgroup_enabled())
+		cgroup_walk(cycle, handle_cgroup);
+	else
+		walk_proc();
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	rule_sweep(cycle);
+	guest_sweep(cycle);
+	burst_sweep(cycle);
+	topk_write(curtime);
+
+	/* samples are safe on disk before the first rrd is touched */
+	journal_write(batch, batch_len, curtime);
+
+	if (record_fd != -1 && batch_len > 0)
+		journal_append(record_fd, batch, batch_len, curtime);
+
+	push_enqueue(batch, batch_len, curtime);
+
+	for (i = 0; i < batch_len; i++)
+		stage_store(&batch[i]);
+
+	stage_commit((stop.tv_sec - start.tv_sec) * 1000 +
+	             (stop.tv_nsec - start.tv_nsec) / 1000000);
+
+	/* the journal may only be dropped as far as the persist stage has
+	 * caught up with it */
+	journal_trim();
+
 	return;
 }
 
+/* push a recorded trace through the storage path as fast as possible */
+static
+void replay(const char *file)
+{
+	LOG_TRACEME
+
+	int fd;
+	struct timespec start, stop;
+
+	if ((fd = open_read(file)) == -1)
+		log_perror_and_die("open_read(%s)", file);
+
+	/* the trace is older than any file it creates */
+	vrrd_replay = journal_first(fd);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int samples = journal_load(fd, vrrd_store);
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	close(fd);
+
+	vrrd_replay = 0;
+
+	if (samples == -1)
+		log_error_and_die("Cannot replay %s", file);
+
+	long msec = (stop.tv_sec - start.tv_sec) * 1000 +
+	            (stop.tv_nsec - start.tv_nsec) / 1000000;
+
+	log_info("Replayed %d samples from %s in %ld ms", samples, file, msec);
+}
+
+/* the log file is reopened on every reload, so it can be rotated */
+static
+void log_open(void)
+{
+	const char *logfile = cfg_getstr(cfg, "logfile");
+	int fd = str_isempty(logfile) ? -1 : open_append(logfile);
+	int oldfd = log_options.log_fd;
+
+	log_options.log_dest &= ~LOGD_FILE;
+	log_options.log_fd    = fd;
+
+	if (fd != -1)
+		log_options.log_dest |= LOGD_FILE;
+
+	log_init(&log_options);
+
+	if (oldfd != -1)
+		close(oldfd);
+}
+
+static
+void write_pidfile(void)
+{
+	const char *pidfile = cfg_getstr(cfg, "pidfile");
+	int fd;
+
+	if (pidfile && (fd = open_trunc(pidfile)) != -1) {
+		dprintf(fd, "%d\n", getpid());
+		close(fd);
+	}
+}
+
+/* parse the configuration file again and apply what changed between two
+ * cycles; modules whose options did not change keep their state */
+static
+void reload_config(void)
+{
+	LOG_TRACEME
+
+	cfg_t *old = cfg, *new = cfg_init(CFG_OPTS, CFGF_NOCASE);
+
+	if (cfg_parse(new, cfg_file) != CFG_SUCCESS) {
+		log_error("Could not parse %s, keeping the running configuration",
+		          cfg_file);
+		cfg_free(new);
+		return;
+	}
+
+	cfg = new;
+
+	/* rules are the only part that can be rejected, so they go first */
+	if (rule_init() == -1) {
+		log_error("Invalid rules in %s, keeping the running configuration",
+		          cfg_file);
+		cfg = old;
+		rule_init();
+		cfg_free(new);
+		return;
+	}
+
+	if (cfg_changed(old, "rule"))
+		guest_forget_rules();
+
+	log_close();
+	log_open();
+	stage_reopen();
+
+	adapt_init();
+	archive_init();
+
+	if (cfg_changed(old, "topk") || cfg_changed(old, "topkfile"))
+		topk_init();
+
+	if (cfg_changed(old, "push") || cfg_changed(old, "push_queue") ||
+	    cfg_changed(old, "push_host"))
+		push_init();
+
+	if (cfg_changed(old, "backend"))
+		cgroup_init();
+
+	if (cfg_changed(old, "burst") || cfg_changed(old, "backend") ||
+	    cfg_changed(old, "adaptive"))
+		burst_init();
+
+	if (cfg_changed(old, "procfs"))
+		procfs_init();
+
+	/* the persist stage works on its copy of the old configuration, and
+	 * the journal may only move once that has caught up */
+	if (cfg_changed(old, "datadir")  || cfg_changed(old, "schema") ||
+	    cfg_changed(old, "journal")  || cfg_changed(old, "pipeline") ||
+	    cfg_changed(old, "pipeline_ring") || cfg_changed(old, "logfile")) {
+		stage_stop();
+		journal_clear();
+
+		if (cfg_changed(old, "datadir"))
+			rate_forget_schemas();
+
+		if (journal_init() == -1)
+			log_error("journal_init failed, running without journal");
+
+		if (stage_init(log_open) == -1)
+			log_error("stage_init failed, storing samples directly");
+	}
+
+	if (cfg_changed(old, "pidfile"))
+		write_pidfile();
+
+	cfg_free(old);
+	log_info("Reloaded %s", cfg_file);
+}
+
+static
+void sighup_handler(int sig)
+{
+	reload = 1;
+}
+
 static
 void sigsegv_handler(int sig, siginfo_t *info, void *ucontext)
 {
@@ -140,7 +531,8 @@ void sigsegv_handler(int sig, siginfo_t *info, void *ucontext)
 
 int main(int argc, char **argv)
 {
-	char *cfg_file = SYSCONFDIR "/vstatd.conf";
+	char *record_file = NULL, *replay_file = NULL, *listen_addr = NULL;
+	char *restore_file = NULL;
 	int c, debug = 0;
 
 	/* install SIGSEGV handler */
@@ -157,7 +549,7 @@ int main(int argc, char **argv)
 	}
 
 	/* parse command line */
-	while ((c = getopt(argc, argv, "dc:")) != -1) {
+	while ((c = getopt(argc, argv, "dc:R:P:L:U:")) != -1) {
 		switch (c) {
 		case 'c':
 			cfg_file = optarg;
@@ -167,6 +559,22 @@ int main(int argc, char **argv)
 			debug = 1;
 			break;
 
+		case 'R':
+			record_file = optarg;
+			break;
+
+		case 'P':
+			replay_file = optarg;
+			break;
+
+		case 'L':
+			listen_addr = optarg;
+			break;
+
+		case 'U':
+			restore_file = optarg;
+			break;
+
 		default:
 			usage(EXIT_FAILURE);
 			break;
@@ -199,30 +607,31 @@ int main(int argc, char **argv)
 	atexit(mem_freeall);
 
 	/* start logging & debugging */
-	log_options_t log_options = {
-		.log_ident    = argv[0],
-		.log_dest     = LOGD_SYSLOG,
-		.log_opts     = LOGO_PRIO|LOGO_TIME|LOGO_IDENT|LOGO_PID,
-		.log_facility = LOG_DAEMON,
-	};
-
-	const char *logfile = cfg_getstr(cfg, "logfile");
-
-	if (!str_isempty(logfile)) {
-		log_options.log_dest |= LOGD_FILE;
-		log_options.log_fd = open_append(logfile);
-	}
+	log_options.log_ident = argv[0];
 
 	if (debug) {
 		log_options.log_dest |= LOGD_STDERR;
 		log_options.log_mask = ((1 << (LOGP_TRACE + 1)) - 1);
 	}
 
-	log_init(&log_options);
+	log_open();
 
 	/* close log multiplexer on exit */
 	atexit(log_close);
 
+	/* replay mode never touches the kernel and runs in foreground */
+	if (replay_file) {
+		replay(replay_file);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (restore_file)
+		exit(archive_restore(restore_file) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	/* relative to the directory vstatd was started in */
+	if (record_file && (record_fd = open_append(record_file)) == -1)
+		log_perror_and_die("open_append(%s)", record_file);
+
 	/* fork to background */
 	if (!debug) {
 		log_info("Running in background mode ...");
@@ -253,18 +662,69 @@ int main(int argc, char **argv)
 	setsid();
 	chdir("/");
 
-	/* log process id */
-	int fd;
-	const char *pidfile = cfg_getstr(cfg, "pidfile");
+	/* reload configuration on SIGHUP, installed before any process or
+	 * thread is started that would inherit the default action */
+	struct sigaction hup;
 
-	if (pidfile && (fd = open_trunc(pidfile)) != -1) {
-		dprintf(fd, "%d\n", getpid());
-		close(fd);
-	}
+	hup.sa_handler = sighup_handler;
+	hup.sa_flags   = SA_RESTART;
+
+	sigemptyset(&hup.sa_mask);
+
+	if (sigaction(SIGHUP, &hup, NULL) == -1)
+		log_perror_and_die("sigaction(SIGHUP)");
+
+	/* reference receiver for the push output stage */
+	if (listen_addr)
+		exit(push_receive(listen_addr) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (journal_init() == -1)
+		log_perror_and_die("journal_init");
+
+	/* samples of an interrupted cycle go in before any new ones */
+	journal_replay();
 
+	if (cgroup_init() == -1)
+		log_perror_and_die("cgroup_init");
+
+	if (procfs_init() == -1)
+		log_perror_and_die("procfs_init");
+
+	if (rule_init() == -1)
+		log_perror_and_die("rule_init");
+
+	if (adapt_init() == -1)
+		log_perror_and_die("adapt_init");
+
+	if (topk_init() == -1)
+		log_perror_and_die("topk_init");
+
+	if (push_init() == -1)
+		log_perror_and_die("push_init");
+
+	if (stage_init(log_open) == -1)
+		log_perror_and_die("stage_init");
+
+	if (archive_init() == -1)
+		log_perror_and_die("archive_init");
+
+	if (burst_init() == -1)
+		log_perror_and_die("burst_init");
+
+	/* log process id */
+	write_pidfile();
+
+	/* cycles start on step boundaries, so all guests are sampled close
+	 * to the time rrd_update aligns their values to */
 	while (1) {
+		if (reload) {
+			reload = 0;
+			reload_config();
+		}
+
 		read_proc();
-		sleep(STEP);
+		archive_run(time(NULL));
+		push_idle(STEP - time(NULL) % STEP);
 	}
 
 	exit(EXIT_SUCCESS);
@@ -0,0 +1,513 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <rrd.h>
+
+#include "datadir.h"
+#include "vrrd.h"
+
+/* worker threads only use libc allocation and formatting, lucid's memory
+ * pool is not thread-safe; lucid is used from the main thread only */
+#include <lucid/log.h>
+#include <lucid/mem.h>
+
+#define MIGRATE_MAXDS  16
+#define MIGRATE_MAXRRA 32
+
+enum {
+	JOB_CURRENT,
+	JOB_MISMATCH,
+	JOB_MIGRATED,
+	JOB_FAILED,
+};
+
+typedef struct {
+	char *path;
+	int status;
+	char *error;
+} migrate_job_t;
+
+/* one archive as configured or as found in a file */
+typedef struct {
+	char cf[16];
+	double xff;
+	unsigned long pdp;
+	unsigned long rows;
+} migrate_rra_t;
+
+static const char *datadir = LOCALSTATEDIR "/vstatd";
+static int dryrun = 0;
+
+static migrate_rra_t layout[MIGRATE_MAXRRA];
+static int nlayout = 0;
+
+static migrate_job_t *jobs = NULL;
+static int njobs = 0, next = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline
+void usage(int rc)
+{
+	printf("Usage: vstatd-migrate [<opts>]\n"
+	       "\n"
+	       "Rebuild all RRD files whose archives differ from the configured\n"
+	       "layout, resampling their data into the new archives. vstatd should\n"
+	       "be stopped, updates of a file during its rebuild are lost.\n"
+	       "\n"
+	       "Available options:\n"
+	       "   -D <dir>      data directory (default: %s/vstatd)\n"
+	       "   -j <n>        number of rebuild threads (default: online CPUs)\n"
+	       "   -n            only report files that would be rebuilt\n"
+	       "   -d            debug mode\n",
+	       LOCALSTATEDIR);
+	exit(rc);
+}
+
+/* the layout every new file is created with, taken from the same
+ * definitions the collectors use */
+static
+void migrate_layout(void)
+{
+	const char *rra[] = { RRA_DEFAULT NULL };
+	int i;
+
+	for (i = 0; rra[i] && nlayout < MIGRATE_MAXRRA; i++) {
+		migrate_rra_t *r = &layout[nlayout];
+
+		if (sscanf(rra[i], "RRA:%15[^:]:%lf:%lu:%lu",
+		           r->cf, &r->xff, &r->pdp, &r->rows) == 4)
+			nlayout++;
+	}
+}
+
+static
+char *migrate_error(const char *what, const char *path)
+{
+	char *error = NULL;
+
+	if (asprintf(&error, "%s(%s): %s", what, path, rrd_get_error()) == -1)
+		error = NULL;
+
+	rrd_clear_error();
+	return error;
+}
+
+/* rrd_info keys look like rra[3].cf or ds[recvb].type */
+static
+int migrate_index(const char *key, const char *prefix, const char *field)
+{
+	size_t plen = strlen(prefix);
+	char *end;
+	long i;
+
+	if (strncmp(key, prefix, plen) != 0)
+		return -1;
+
+	i = strtol(key + plen, &end, 10);
+
+	if (end == key + plen || *end != ']' || strcmp(end + 1, field) != 0)
+		return -1;
+
+	return i >= 0 && i < MIGRATE_MAXRRA ? i : -1;
+}
+
+static
+void migrate_num(char *buf, size_t len, double value)
+{
+	if (isnan(value))
+		snprintf(buf, len, "U");
+	else
+		snprintf(buf, len, "%.0f", value);
+}
+
+/* compare the archives of one file with the configured layout and rebuild
+ * it from itself into a temporary file, which then replaces it */
+static
+void migrate_job(migrate_job_t *job)
+{
+	migrate_rra_t rra[MIGRATE_MAXRRA];
+	char *ds[MIGRATE_MAXDS], *dsdef[MIGRATE_MAXDS];
+	unsigned long step = 0, last = 0, hb = atoi(HEARTBEAT);
+	int nrra = 0, nds = 0, heartbeat = 1, i, j;
+	rrd_info_t *info, *p;
+	char *end;
+
+	memset(rra, 0, sizeof(rra));
+	memset(ds, 0, sizeof(ds));
+
+	if (!(info = rrd_info_r(job->path))) {
+		job->error  = migrate_error("rrd_info", job->path);
+		job->status = JOB_FAILED;
+		return;
+	}
+
+	for (p = info; p; p = p->next) {
+		if (strcmp(p->key, "step") == 0)
+			step = p->value.u_cnt;
+
+		else if (strcmp(p->key, "last_update") == 0)
+			last = p->value.u_cnt;
+
+		else if ((i = migrate_index(p->key, "rra[", ".cf")) != -1) {
+			snprintf(rra[i].cf, sizeof(rra[i].cf), "%s", p->value.u_str);
+			nrra = i + 1 > nrra ? i + 1 : nrra;
+		}
+
+		else if ((i = migrate_index(p->key, "rra[", ".rows")) != -1)
+			rra[i].rows = p->value.u_cnt;
+
+		else if ((i = migrate_index(p->key, "rra[", ".pdp_per_row")) != -1)
+			rra[i].pdp = p->value.u_cnt;
+
+		else if ((i = migrate_index(p->key, "rra[", ".xff")) != -1)
+			rra[i].xff = p->value.u_val;
+
+		else if (strncmp(p->key, "ds[", 3) == 0 &&
+		         (end = strstr(p->key, "].minimal_heartbeat")) &&
+		         strcmp(end, "].minimal_heartbeat") == 0 &&
+		         p->value.u_cnt != hb)
+			heartbeat = 0;
+	}
+
+	job->status = JOB_CURRENT;
+
+	if (step != STEP || nrra != nlayout || !heartbeat)
+		job->status = JOB_MISMATCH;
+
+	for (i = 0; i < nrra && job->status == JOB_CURRENT; i++)
+		if (strcmp(rra[i].cf, layout[i].cf) != 0 ||
+		    fabs(rra[i].xff - layout[i].xff) > 1e-6 ||
+		    rra[i].pdp != layout[i].pdp || rra[i].rows != layout[i].rows)
+			job->status = JOB_MISMATCH;
+
+	if (job->status == JOB_CURRENT || dryrun) {
+		rrd_info_free(info);
+		return;
+	}
+
+	/* the data sources are kept as they are, in index order, only with
+	 * the configured heartbeat */
+	for (p = info; p; p = p->next) {
+		char *name;
+		unsigned long idx;
+
+		if (p->type != RD_I_CNT || strncmp(p->key, "ds[", 3) != 0 ||
+		    !(end = strstr(p->key, "].index")))
+			continue;
+
+		if ((idx = p->value.u_cnt) >= MIGRATE_MAXDS)
+			continue;
+
+		name = p->key + 3;
+		ds[idx] = strndup(name, end - name);
+
+		if (idx + 1 > (unsigned long) nds)
+			nds = idx + 1;
+	}
+
+	for (i = 0; i < nds; i++) {
+		char key[96], type[16] = "GAUGE", min[32] = "U", max[32] = "U";
+
+		for (p = info; p && ds[i]; p = p->next) {
+			if (strncmp(p->key, "ds[", 3) != 0)
+				continue;
+
+			snprintf(key, sizeof(key), "ds[%s].type", ds[i]);
+			if (strcmp(p->key, key) == 0)
+				snprintf(type, sizeof(type), "%s", p->value.u_str);
+
+			snprintf(key, sizeof(key), "ds[%s].min", ds[i]);
+			if (strcmp(p->key, key) == 0)
+				migrate_num(min, sizeof(min), p->value.u_val);
+
+			snprintf(key, sizeof(key), "ds[%s].max", ds[i]);
+			if (strcmp(p->key, key) == 0)
+				migrate_num(max, sizeof(max), p->value.u_val);
+		}
+
+		dsdef[i] = NULL;
+
+		if (ds[i] && asprintf(&dsdef[i], "DS:%s:%s:%lu:%s:%s",
+		                      ds[i], type, hb, min, max) == -1)
+			dsdef[i] = NULL;
+	}
+
+	rrd_info_free(info);
+
+	const char *rras[] = { RRA_DEFAULT NULL };
+	const char *argv[MIGRATE_MAXDS + MIGRATE_MAXRRA];
+	int argc = 0;
+
+	for (i = 0; i < nds; i++)
+		if (dsdef[i])
+			argv[argc++] = dsdef[i];
+
+	for (j = 0; rras[j] && j < MIGRATE_MAXRRA; j++)
+		argv[argc++] = rras[j];
+
+	char *tmp = NULL;
+	const char *sources[] = { job->path, NULL };
+
+	if (asprintf(&tmp, "%s.migrate", job->path) == -1)
+		tmp = NULL;
+
+	job->status = JOB_FAILED;
+
+#ifdef HAVE_RRD_CREATE_R2
+	/* rrdtool resamples the old archives into the new ones itself */
+	if (!tmp)
+		;
+
+	else if (rrd_create_r2(tmp, STEP, last, 0, sources, NULL, argc, argv) == -1)
+		job->error = migrate_error("rrd_create", tmp);
+
+	else {
+		int fd = open(tmp, O_RDONLY);
+
+		/* the new file is complete on disk before it replaces the old */
+		if (fd == -1 || fsync(fd) == -1 || rename(tmp, job->path) == -1) {
+			if (asprintf(&job->error, "replacing %s failed", job->path) == -1)
+				job->error = NULL;
+
+			unlink(tmp);
+		}
+
+		else
+			job->status = JOB_MIGRATED;
+
+		if (fd != -1)
+			close(fd);
+	}
+#else
+	(void) sources;
+	(void) argv;
+	(void) last;
+
+	if (asprintf(&job->error, "%s: librrd lacks rrd_create_r2", job->path) == -1)
+		job->error = NULL;
+#endif
+
+	free(tmp);
+
+	for (i = 0; i < nds; i++) {
+		free(ds[i]);
+		free(dsdef[i]);
+	}
+}
+
+/* rebuilds interrupted before their rename leave <file>.migrate behind */
+static
+void migrate_clean(const char *guest)
+{
+	char *dir = NULL, *path = NULL;
+	struct dirent *ditp;
+	DIR *dirp;
+
+	if (asprintf(&dir, "%s/%s", datadir, guest) == -1)
+		return;
+
+	if (!(dirp = opendir(dir))) {
+		free(dir);
+		return;
+	}
+
+	while ((ditp = readdir(dirp))) {
+		size_t len = strlen(ditp->d_name);
+
+		if (len <= 12 || strcmp(ditp->d_name + len - 12, ".rrd.migrate") != 0)
+			continue;
+
+		if (asprintf(&path, "%s/%s", dir, ditp->d_name) == -1)
+			continue;
+
+		if (dryrun)
+			log_info("%s is left from an interrupted rebuild", path);
+
+		else if (unlink(path) == -1)
+			log_perror("unlink(%s)", path);
+
+		else
+			log_info("Removed %s left from an interrupted rebuild", path);
+
+		free(path);
+	}
+
+	closedir(dirp);
+	free(dir);
+}
+
+static
+void *migrate_worker(void *arg)
+{
+	while (1) {
+		pthread_mutex_lock(&lock);
+
+		if (next >= njobs) {
+			pthread_mutex_unlock(&lock);
+			return NULL;
+		}
+
+		migrate_job_t *job = &jobs[next++];
+
+		pthread_mutex_unlock(&lock);
+
+		migrate_job(job);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int c, debug = 0, threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "D:j:nd")) != -1) {
+		switch (c) {
+		case 'D':
+			datadir = optarg;
+			break;
+
+		case 'j':
+			threads = atoi(optarg);
+			break;
+
+		case 'n':
+			dryrun = 1;
+			break;
+
+		case 'd':
+			debug = 1;
+			break;
+
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (argc > optind)
+		usage(EXIT_FAILURE);
+
+	if (threads < 1)
+		threads = 1;
+
+	atexit(mem_freeall);
+
+	log_options_t log_options = {
+		.log_ident    = argv[0],
+		.log_dest     = LOGD_STDERR,
+		.log_opts     = LOGO_PRIO|LOGO_IDENT,
+		.log_facility = LOG_DAEMON,
+	};
+
+	if (debug)
+		log_options.log_mask = ((1 << (LOGP_TRACE + 1)) - 1);
+
+	log_init(&log_options);
+	atexit(log_close);
+
+	migrate_layout();
+
+	char **guests;
+	int nguests = datadir_guests(datadir, &guests);
+	int i, j;
+
+	if (nguests == -1)
+		exit(EXIT_FAILURE);
+
+	for (i = 0; i < nguests; i++) {
+		char **rrds;
+		int nrrds;
+
+		migrate_clean(guests[i]);
+
+		if ((nrrds = datadir_rrds(datadir, guests[i], &rrds)) < 1)
+			continue;
+
+		migrate_job_t *p = mem_realloc(jobs, (njobs + nrrds) * sizeof(migrate_job_t));
+
+		if (!p)
+			log_perror_and_die("mem_realloc");
+
+		jobs = p;
+
+		for (j = 0; j < nrrds; j++) {
+			migrate_job_t *job = &jobs[njobs++];
+
+			job->path   = NULL;
+			job->status = JOB_CURRENT;
+			job->error  = NULL;
+
+			if (asprintf(&job->path, "%s/%s/%s", datadir, guests[i], rrds[j]) == -1)
+				log_perror_and_die("asprintf");
+		}
+
+		datadir_free(rrds, nrrds);
+	}
+
+	datadir_free(guests, nguests);
+
+	pthread_t *tids = mem_alloc(threads * sizeof(pthread_t));
+
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tids[i], NULL, migrate_worker, NULL) != 0)
+			log_perror_and_die("pthread_create");
+
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+
+	int current = 0, mismatch = 0, migrated = 0, failed = 0;
+
+	for (i = 0; i < njobs; i++) {
+		switch (jobs[i].status) {
+		case JOB_CURRENT:
+			current++;
+			break;
+
+		case JOB_MISMATCH:
+			log_info("%s differs from the configured layout", jobs[i].path);
+			mismatch++;
+			break;
+
+		case JOB_MIGRATED:
+			log_debug("%s rebuilt", jobs[i].path);
+			migrated++;
+			break;
+
+		default:
+			log_error("%s", jobs[i].error ? jobs[i].error : jobs[i].path);
+			failed++;
+			break;
+		}
+
+		free(jobs[i].error);
+		free(jobs[i].path);
+	}
+
+	log_info("%d files current, %d to rebuild, %d rebuilt, %d failed",
+	         current, mismatch, migrated, failed);
+
+	exit(failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,644 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include "cfg.h"
+#include "procfs.h"
+#include "vrrd.h"
+
+#include <lucid/log.h>
+#include <lucid/mem.h>
+
+/* per-guest files are small, one buffer holds a complete file */
+#define PROCFS_BUFSZ  4096
+#define PROCFS_WINDOW 128
+
+enum {
+	PROCFS_CACCT,
+	PROCFS_CVIRT,
+	PROCFS_LIMIT,
+	PROCFS_SCHED,
+	PROCFS_NR,
+};
+
+static const char *FILES[PROCFS_NR] = { "cacct", "cvirt", "limit", "sched" };
+
+/* family names in the order of CACCT_* */
+static const char *FAMILIES[CACCT_NR] = {
+	"UNSPEC", "UNIX", "INET", "INET6", "PACKET", "OTHER",
+};
+
+/* limit names in the order of LIMIT_* */
+static const char *LIMITS[LIMIT_NR] = {
+	"VM", "LOCKS", "VML", "MSGQ", "FILES", "PROC", "RSS", "ANON",
+	"DENT", "RMAP", "SEMS", "SOCK", "OFD", "SEMA", "SHM",
+};
+
+typedef struct {
+	sample_t *s;
+	int file;
+	int fd;
+	char *path;
+} procfs_job_t;
+
+static int enabled = 0;
+static char *buffers = NULL;
+
+/* one path per job, sized for the configured procdir */
+static char *paths = NULL;
+static size_t paths_size = 0;
+
+static procfs_job_t *jobs = NULL;
+static int jobs_size = 0;
+
+static
+int procfs_parse_cacct(sample_t *s, char *buf)
+{
+	char *line, *next;
+	int i, found = 0;
+
+	for (line = buf; line; line = next) {
+		char name[16];
+		uint64_t v[6];
+
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+
+		if (sscanf(line, "%15[^:]: %" SCNu64 "/%" SCNu64 " %" SCNu64 "/%"
+		           SCNu64 " %" SCNu64 "/%" SCNu64,
+		           name, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 7)
+			continue;
+
+		for (i = 0; i < CACCT_NR; i++) {
+			if (strcmp(name, FAMILIES[i]) != 0)
+				continue;
+
+			s->cacct[i].recvp = v[0];
+			s->cacct[i].recvb = v[1];
+			s->cacct[i].sendp = v[2];
+			s->cacct[i].sendb = v[3];
+			s->cacct[i].failp = v[4];
+			s->cacct[i].failb = v[5];
+			found++;
+		}
+	}
+
+	return found == CACCT_NR ? 0 : -1;
+}
+
+/* loadavg is printed as %d.%02d, convert it back to the kernel's
+ * fixed point representation returned by vx_stat */
+static
+uint64_t procfs_load(unsigned int whole, unsigned int frac)
+{
+	return ((uint64_t) whole << 11) + (frac * 2048 + 50) / 100;
+}
+
+static
+int procfs_parse_cvirt(sample_t *s, char *buf)
+{
+	char *line, *next;
+	int found = 0;
+
+	for (line = buf; line; line = next) {
+		unsigned int l[6];
+		uint64_t v;
+
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+
+		if (sscanf(line, "nr_threads: %" SCNu64, &v) == 1)
+			s->cvirt[CVIRT_TOTAL] = v, found++;
+
+		else if (sscanf(line, "nr_running: %" SCNu64, &v) == 1)
+			s->cvirt[CVIRT_RUNNING] = v, found++;
+
+		else if (sscanf(line, "nr_uninterruptible: %" SCNu64, &v) == 1)
+			s->cvirt[CVIRT_UNINTR] = v, found++;
+
+		else if (sscanf(line, "nr_onhold: %" SCNu64, &v) == 1)
+			s->cvirt[CVIRT_ONHOLD] = v, found++;
+
+		else if (sscanf(line, "loadavg: %u.%u %u.%u %u.%u",
+		                &l[0], &l[1], &l[2], &l[3], &l[4], &l[5]) == 6) {
+			s->loadavg[LOADAVG_1MIN]  = procfs_load(l[0], l[1]);
+			s->loadavg[LOADAVG_5MIN]  = procfs_load(l[2], l[3]);
+			s->loadavg[LOADAVG_15MIN] = procfs_load(l[4], l[5]);
+			s->loadavg_time = s->cvirt_time;
+			found++;
+		}
+	}
+
+	return found == CVIRT_NR + 1 ? 0 : -1;
+}
+
+static
+int procfs_parse_limit(sample_t *s, char *buf)
+{
+	char *line, *next;
+	int i, found = 0;
+
+	for (line = buf; line; line = next) {
+		char name[16];
+		uint64_t cur, min, max;
+
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+
+		if (sscanf(line, "%15[^:]: %" SCNu64 " %" SCNu64 "/%" SCNu64,
+		           name, &cur, &min, &max) != 4)
+			continue;
+
+		for (i = 0; i < LIMIT_NR; i++) {
+			if (strcmp(name, LIMITS[i]) != 0)
+				continue;
+
+			s->limit[i].min = min;
+			s->limit[i].cur = cur;
+			s->limit[i].max = max;
+			found++;
+		}
+	}
+
+	/* the watermarks are per interval, like in limit_fetch */
+	if (found > 0 && vx_limit_reset(s->id) == -1)
+		log_pwarn("vx_reset_rlimit(%" PRIu64 ")", s->id);
+
+	return found > 0 ? 0 : -1;
+}
+
+/* parse one file's content and mark its part of the sample valid */
+static
+void procfs_parse(procfs_job_t *job, char *buf, ssize_t len)
+{
+	sample_t *s = job->s;
+	time_t now = time(NULL);
+
+	if (len < 0) {
+		log_error("read(%s): %s", job->path, strerror(-len));
+		return;
+	}
+
+	buf[len] = '\0';
+
+	switch (job->file) {
+	case PROCFS_CACCT:
+		if (procfs_parse_cacct(s, buf) == 0)
+			s->cacct_time = now;
+		break;
+
+	case PROCFS_CVIRT:
+		s->cvirt_time = now;
+
+		if (procfs_parse_cvirt(s, buf) == -1)
+			s->cvirt_time = s->loadavg_time = 0;
+		break;
+
+	case PROCFS_LIMIT:
+		if (procfs_parse_limit(s, buf) == 0)
+			s->limit_time = now;
+		break;
+
+	case PROCFS_SCHED:
+		if (sched_parse(s, buf) == 0)
+			s->sched_time = now;
+		break;
+	}
+}
+
+static
+void procfs_plain(procfs_job_t *job, int count)
+{
+	LOG_TRACEME
+
+	int i;
+
+	for (i = 0; i < count; i++) {
+		char *buf = buffers;
+		ssize_t len;
+		int fd;
+
+		if ((fd = open(job[i].path, O_RDONLY)) == -1) {
+			if (errno != ENOENT || job[i].file != PROCFS_SCHED)
+				log_perror("open(%s)", job[i].path);
+			continue;
+		}
+
+		len = read(fd, buf, PROCFS_BUFSZ - 1);
+		close(fd);
+
+		procfs_parse(&job[i], buf, len == -1 ? -errno : len);
+	}
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+static struct {
+	int fd;
+	unsigned int entries;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} ring = { .fd = -1 };
+
+static
+int procfs_ring_init(void)
+{
+	LOG_TRACEME
+
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+
+	ring.fd = syscall(__NR_io_uring_setup, PROCFS_WINDOW, &p);
+
+	if (ring.fd == -1)
+		return -1;
+
+	size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		sq_len = cq_len = sq_len > cq_len ? sq_len : cq_len;
+
+	sq = mmap(NULL, sq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+	          ring.fd, IORING_OFF_SQ_RING);
+
+	if (sq == MAP_FAILED)
+		goto err;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+
+	else {
+		cq = mmap(NULL, cq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		          ring.fd, IORING_OFF_CQ_RING);
+
+		if (cq == MAP_FAILED)
+			goto err;
+	}
+
+	ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	                 PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+	                 ring.fd, IORING_OFF_SQES);
+
+	if (ring.sqes == MAP_FAILED)
+		goto err;
+
+	ring.entries  = p.sq_entries;
+	ring.sq_head  = (unsigned int *) ((char *) sq + p.sq_off.head);
+	ring.sq_tail  = (unsigned int *) ((char *) sq + p.sq_off.tail);
+	ring.sq_mask  = (unsigned int *) ((char *) sq + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned int *) ((char *) sq + p.sq_off.array);
+	ring.cq_head  = (unsigned int *) ((char *) cq + p.cq_off.head);
+	ring.cq_tail  = (unsigned int *) ((char *) cq + p.cq_off.tail);
+	ring.cq_mask  = (unsigned int *) ((char *) cq + p.cq_off.ring_mask);
+	ring.cqes     = (struct io_uring_cqe *) ((char *) cq + p.cq_off.cqes);
+
+	/* all reads land in one registered region, saving the kernel from
+	 * mapping user pages for every request */
+	struct iovec iov = { buffers, PROCFS_WINDOW * PROCFS_BUFSZ };
+
+	if (syscall(__NR_io_uring_register, ring.fd,
+	            IORING_REGISTER_BUFFERS, &iov, 1) == -1)
+		goto err;
+
+	return 0;
+
+err:
+	close(ring.fd);
+	ring.fd = -1;
+	return -1;
+}
+
+static
+struct io_uring_sqe *procfs_sqe(void)
+{
+	unsigned int tail = *ring.sq_tail;
+	unsigned int idx  = tail & *ring.sq_mask;
+	struct io_uring_sqe *sqe = &ring.sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	ring.sq_array[idx] = idx;
+
+	__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+/* completions not yet seen */
+static
+unsigned int procfs_ready(void)
+{
+	return __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE) - *ring.cq_head;
+}
+
+/* submit the n entries queued in this window and wait for all of them to
+ * complete; the kernel does not wait after a partial submit, so the rest
+ * is submitted again and whatever was submitted is always waited for,
+ * otherwise late completions would end up in the next window. If not
+ * everything can be submitted, the remaining entries are dropped and -1
+ * returned */
+static
+int procfs_submit(unsigned int n)
+{
+	unsigned int done = 0;
+	int rc;
+
+	while (done < n) {
+		rc = syscall(__NR_io_uring_enter, ring.fd, n - done, n,
+		             IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			break;
+
+		done += rc;
+	}
+
+	while (procfs_ready() < done) {
+		rc = syscall(__NR_io_uring_enter, ring.fd, 0, done,
+		             IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if (rc == -1 && errno != EINTR)
+			break;
+	}
+
+	if (done < n) {
+		__atomic_store_n(ring.sq_tail,
+		                 __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE),
+		                 __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	return 0;
+}
+
+static
+struct io_uring_cqe *procfs_cqe(void)
+{
+	unsigned int head = *ring.cq_head;
+
+	if (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &ring.cqes[head & *ring.cq_mask];
+}
+
+static
+void procfs_cqe_seen(void)
+{
+	__atomic_store_n(ring.cq_head, *ring.cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* give up on a window: drop pending completions and close what was opened */
+static
+int procfs_abort(procfs_job_t *job, int count)
+{
+	int i;
+
+	while (procfs_cqe())
+		procfs_cqe_seen();
+
+	for (i = 0; i < count; i++) {
+		if (job[i].fd != -1)
+			close(job[i].fd);
+
+		job[i].fd = -1;
+	}
+
+	return -1;
+}
+
+/* one window of at most PROCFS_WINDOW files: a batch of opens, a batch
+ * of fixed buffer reads parsed as they complete and a batch of closes */
+static
+int procfs_uring(procfs_job_t *job, int count)
+{
+	LOG_TRACEME
+
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned int n = 0;
+	int i, failed, unsupported = 0;
+
+	for (i = 0; i < count; i++) {
+		sqe = procfs_sqe();
+		sqe->opcode     = IORING_OP_OPENAT;
+		sqe->fd         = AT_FDCWD;
+		sqe->addr       = (uintptr_t) job[i].path;
+		sqe->open_flags = O_RDONLY;
+		sqe->user_data  = i;
+		job[i].fd = -1;
+	}
+
+	/* opens that completed before a failure still return a descriptor */
+	failed = procfs_submit(count) == -1;
+
+	while ((cqe = procfs_cqe())) {
+		i = cqe->user_data;
+
+		/* kernels before 5.6 know io_uring but not openat */
+		if (cqe->res == -EINVAL)
+			unsupported = 1;
+
+		else if (cqe->res < 0) {
+			/* the sched file is optional, see sched_fetch */
+			if (cqe->res != -ENOENT || job[i].file != PROCFS_SCHED)
+				log_error("open(%s): %s", job[i].path, strerror(-cqe->res));
+		}
+		else
+			job[i].fd = cqe->res;
+
+		procfs_cqe_seen();
+	}
+
+	if (failed || unsupported)
+		return procfs_abort(job, count);
+
+	for (i = 0; i < count; i++) {
+		if (job[i].fd == -1)
+			continue;
+
+		sqe = procfs_sqe();
+		sqe->opcode    = IORING_OP_READ_FIXED;
+		sqe->fd        = job[i].fd;
+		sqe->addr      = (uintptr_t) (buffers + i * PROCFS_BUFSZ);
+		sqe->len       = PROCFS_BUFSZ - 1;
+		sqe->buf_index = 0;
+		sqe->user_data = i;
+		n++;
+	}
+
+	if (procfs_submit(n) == -1)
+		return procfs_abort(job, count);
+
+	while ((cqe = procfs_cqe())) {
+		i = cqe->user_data;
+		procfs_parse(&job[i], buffers + i * PROCFS_BUFSZ, cqe->res);
+		procfs_cqe_seen();
+	}
+
+	n = 0;
+
+	for (i = 0; i < count; i++) {
+		if (job[i].fd == -1)
+			continue;
+
+		sqe = procfs_sqe();
+		sqe->opcode    = IORING_OP_CLOSE;
+		sqe->fd        = job[i].fd;
+		sqe->user_data = i;
+		n++;
+	}
+
+	procfs_submit(n);
+
+	while ((cqe = procfs_cqe())) {
+		job[cqe->user_data].fd = -1;
+		procfs_cqe_seen();
+	}
+
+	/* closes that were not submitted */
+	for (i = 0; i < count; i++) {
+		if (job[i].fd != -1)
+			close(job[i].fd);
+
+		job[i].fd = -1;
+	}
+
+	return 0;
+}
+#endif
+
+int procfs_init(void)
+{
+	LOG_TRACEME
+
+	enabled = cfg_getbool(cfg, "procfs");
+
+	/* buffers and ring stay set up across reloads */
+	if (!enabled || buffers)
+		return 0;
+
+	if (!(buffers = mem_alloc(PROCFS_WINDOW * PROCFS_BUFSZ)))
+		return -1;
+
+#ifdef HAVE_LINUX_IO_URING_H
+	if (procfs_ring_init() == -1)
+		log_info("io_uring not available, using plain reads");
+	else
+		log_debug("Reading %s through io_uring", cfg_getstr(cfg, "procdir"));
+#endif
+
+	return 0;
+}
+
+int procfs_enabled(void)
+{
+	return enabled;
+}
+
+/* fill all counters of every sample in batch, whose ids must be set */
+void procfs_fetch(sample_t *batch, int count)
+{
+	LOG_TRACEME
+
+	const char *procdir = cfg_getstr(cfg, "procdir");
+	size_t pathlen = strlen(procdir) + 32;
+	int i, f, n = count * PROCFS_NR;
+
+	if (n > jobs_size) {
+		procfs_job_t *p = mem_realloc(jobs, n * sizeof(procfs_job_t));
+
+		if (!p) {
+			log_perror("mem_realloc");
+			return;
+		}
+
+		jobs      = p;
+		jobs_size = n;
+	}
+
+	if (n * pathlen > paths_size) {
+		char *p = mem_realloc(paths, n * pathlen);
+
+		if (!p) {
+			log_perror("mem_realloc");
+			return;
+		}
+
+		paths      = p;
+		paths_size = n * pathlen;
+	}
+
+	for (i = 0; i < count; i++) {
+		sample_t *s = &batch[i];
+
+		s->cacct_time = s->cvirt_time = s->limit_time = s->loadavg_time = 0;
+		s->sched_time = 0;
+
+		for (f = 0; f < PROCFS_NR; f++) {
+			procfs_job_t *job = &jobs[i * PROCFS_NR + f];
+
+			job->s    = s;
+			job->file = f;
+			job->fd   = -1;
+			job->path = paths + (i * PROCFS_NR + f) * pathlen;
+
+			snprintf(job->path, pathlen, "%s/%" PRIu64 "/%s",
+			         procdir, s->id, FILES[f]);
+		}
+	}
+
+	for (i = 0; i < n; i += PROCFS_WINDOW) {
+		int window = n - i < PROCFS_WINDOW ? n - i : PROCFS_WINDOW;
+
+#ifdef HAVE_LINUX_IO_URING_H
+		if (ring.fd != -1 && procfs_uring(&jobs[i], window) == 0)
+			continue;
+
+		if (ring.fd != -1) {
+			log_warn("io_uring failed, falling back to plain reads");
+			close(ring.fd);
+			ring.fd = -1;
+		}
+#endif
+
+		procfs_plain(&jobs[i], window);
+	}
+}
+
+int procfs_complete(const sample_t *s)
+{
+	return s->cacct_time && s->cvirt_time && s->loadavg_time && s->limit_time;
+}
@@ -0,0 +1,841 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cfg.h"
+#include "push.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/printf.h>
+#include <lucid/str.h>
+
+#define PUSH_BACKOFF_MIN 1
+#define PUSH_BACKOFF_MAX 300
+
+#define PUSH_MAGIC   0x56535450 /* "VSTP" */
+#define PUSH_VERSION 1
+#define PUSH_HDRLEN  24
+#define PUSH_MAXLEN  (64 << 20)
+
+/* A batch on the wire, all integers big-endian:
+ *
+ *   header   magic (4), version (2), host length (2), payload length (4),
+ *            sample count (4), cycle time (8)
+ *   host     name of the sending host
+ *   payload  per sample: id (8), name length (1), name, number of
+ *            families (1), then per family: tag (1), number of values (1),
+ *            time (8), values (8 each)
+ *
+ * The journal and recorded traces store samples in the same encoding,
+ * through push_size(), push_encode() and push_decode().
+ *
+ * Tags and the values of a family are only ever appended, never reused or
+ * reordered: a receiver skips tags it does not know and leaves values an
+ * older sender does not have at 0, so mixed versions interoperate. The
+ * version only changes if the framing itself does. */
+#define PUSH_FAMILY(tag, time, values) \
+	{ tag, offsetof(sample_t, time), offsetof(sample_t, values), \
+	  sizeof(((sample_t *) 0)->values) / (sizeof(uint64_t)) }
+
+static
+struct push_family {
+	uint8_t tag;
+	size_t time;
+	size_t values;
+	uint8_t count;
+} FAMILIES[] = {
+	PUSH_FAMILY(1, cacct_time,   cacct),
+	PUSH_FAMILY(2, cvirt_time,   cvirt),
+	PUSH_FAMILY(3, limit_time,   limit),
+	PUSH_FAMILY(4, loadavg_time, loadavg),
+	PUSH_FAMILY(5, sched_time,   sched),
+	PUSH_FAMILY(6, dlimit_time,  dlimit),
+	PUSH_FAMILY(7, cgroup_time,  cpu),
+	PUSH_FAMILY(8, cgroup_time,  io),
+	PUSH_FAMILY(9, burst_time,   burst),
+	PUSH_FAMILY(10, limit_time,  limit_hard),
+	{ 0, 0, 0, 0 }
+};
+
+/* one encoded batch */
+typedef struct {
+	void *buf;
+	size_t len;
+} push_batch_t;
+
+static char *target = NULL;
+
+/* sent with every batch, the receiver keeps one datadir per host */
+static char *host = NULL;
+
+/* ring of pending batches, new batches are dropped while it is full */
+static push_batch_t *queue = NULL;
+static int queue_size = 0, queue_head = 0, queue_len = 0;
+static size_t head_off = 0;
+
+static int sock = -1, connecting = 0;
+static int backoff = PUSH_BACKOFF_MIN;
+static time_t retry = 0;
+
+static unsigned long dropped_batches = 0, dropped_samples = 0;
+
+static inline
+unsigned char *push_put8(unsigned char *p, uint8_t v)
+{
+	*p = v;
+	return p + 1;
+}
+
+static inline
+unsigned char *push_put16(unsigned char *p, uint16_t v)
+{
+	v = htobe16(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline
+unsigned char *push_put32(unsigned char *p, uint32_t v)
+{
+	v = htobe32(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline
+unsigned char *push_put64(unsigned char *p, uint64_t v)
+{
+	v = htobe64(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+/* bounds checked reader, a short read leaves everything at 0 */
+typedef struct {
+	const unsigned char *p, *end;
+	int short_read;
+} push_reader_t;
+
+static
+const unsigned char *push_get(push_reader_t *r, size_t len)
+{
+	const unsigned char *p = r->p;
+
+	if ((size_t) (r->end - r->p) < len) {
+		r->short_read = 1;
+		r->p = r->end;
+		return NULL;
+	}
+
+	r->p += len;
+	return p;
+}
+
+static
+uint8_t push_get8(push_reader_t *r)
+{
+	const unsigned char *p = push_get(r, 1);
+
+	return p ? *p : 0;
+}
+
+static
+uint16_t push_get16(push_reader_t *r)
+{
+	const unsigned char *p = push_get(r, 2);
+	uint16_t v = 0;
+
+	if (p)
+		memcpy(&v, p, sizeof(v));
+
+	return be16toh(v);
+}
+
+static
+uint32_t push_get32(push_reader_t *r)
+{
+	const unsigned char *p = push_get(r, 4);
+	uint32_t v = 0;
+
+	if (p)
+		memcpy(&v, p, sizeof(v));
+
+	return be32toh(v);
+}
+
+static
+uint64_t push_get64(push_reader_t *r)
+{
+	const unsigned char *p = push_get(r, 8);
+	uint64_t v = 0;
+
+	if (p)
+		memcpy(&v, p, sizeof(v));
+
+	return be64toh(v);
+}
+
+static inline
+time_t push_time(const sample_t *s, int f)
+{
+	return *(const time_t *) ((const char *) s + FAMILIES[f].time);
+}
+
+/* length of the encoding of s */
+size_t push_size(const sample_t *s)
+{
+	size_t size = 8 + 1 + strnlen(s->name, SAMPLE_NAMELEN - 1) + 1;
+	int f;
+
+	for (f = 0; FAMILIES[f].tag; f++)
+		if (push_time(s, f))
+			size += 1 + 1 + 8 + 8 * FAMILIES[f].count;
+
+	return size;
+}
+
+/* encode s at buf, which has room for push_size(s) bytes, and return the
+ * end of the encoding */
+void *push_encode(void *buf, const sample_t *s)
+{
+	size_t namelen = strnlen(s->name, SAMPLE_NAMELEN - 1);
+	unsigned char *p = buf;
+	int families = 0, f, k;
+
+	for (f = 0; FAMILIES[f].tag; f++)
+		if (push_time(s, f))
+			families++;
+
+	p = push_put64(p, s->id);
+	p = push_put8(p, namelen);
+
+	memcpy(p, s->name, namelen);
+	p += namelen;
+
+	p = push_put8(p, families);
+
+	for (f = 0; FAMILIES[f].tag; f++) {
+		const uint64_t *v = (const uint64_t *) ((const char *) s + FAMILIES[f].values);
+
+		if (!push_time(s, f))
+			continue;
+
+		p = push_put8(p, FAMILIES[f].tag);
+		p = push_put8(p, FAMILIES[f].count);
+		p = push_put64(p, (uint64_t) (int64_t) push_time(s, f));
+
+		for (k = 0; k < FAMILIES[f].count; k++)
+			p = push_put64(p, v[k]);
+	}
+
+	return p;
+}
+
+static
+void *push_pack(sample_t *batch, int count, time_t curtime, size_t *len)
+{
+	LOG_TRACEME
+
+	size_t hostlen = str_len(host), size = PUSH_HDRLEN + hostlen;
+	unsigned char *buf, *p;
+	int i;
+
+	for (i = 0; i < count; i++)
+		size += push_size(&batch[i]);
+
+	if (size > PUSH_MAXLEN || !(buf = mem_alloc(size)))
+		return NULL;
+
+	p = push_put32(buf, PUSH_MAGIC);
+	p = push_put16(p, PUSH_VERSION);
+	p = push_put16(p, hostlen);
+	p = push_put32(p, size - PUSH_HDRLEN - hostlen);
+	p = push_put32(p, count);
+	p = push_put64(p, (uint64_t) (int64_t) curtime);
+
+	memcpy(p, host, hostlen);
+	p += hostlen;
+
+	for (i = 0; i < count; i++)
+		p = push_encode(p, &batch[i]);
+
+	*len = size;
+	return buf;
+}
+
+/* decode the next sample of a payload, -1 if it is malformed */
+static
+int push_unpack(push_reader_t *r, sample_t *s)
+{
+	LOG_TRACEME
+
+	const unsigned char *name;
+	int families, i, k, f;
+
+	memset(s, 0, sizeof(*s));
+
+	s->id = push_get64(r);
+
+	i = push_get8(r);
+
+	if (i >= SAMPLE_NAMELEN || !(name = push_get(r, i)))
+		return -1;
+
+	memcpy(s->name, name, i);
+
+	families = push_get8(r);
+
+	for (i = 0; i < families && !r->short_read; i++) {
+		uint8_t tag = push_get8(r), count = push_get8(r);
+		time_t t = (time_t) (int64_t) push_get64(r);
+
+		for (f = 0; FAMILIES[f].tag; f++)
+			if (FAMILIES[f].tag == tag)
+				break;
+
+		/* a family of a newer sender */
+		if (!FAMILIES[f].tag) {
+			push_get(r, 8 * (size_t) count);
+			continue;
+		}
+
+		uint64_t *v = (uint64_t *) ((char *) s + FAMILIES[f].values);
+
+		*(time_t *) ((char *) s + FAMILIES[f].time) = t;
+
+		for (k = 0; k < count; k++) {
+			uint64_t value = push_get64(r);
+
+			if (k < FAMILIES[f].count)
+				v[k] = value;
+		}
+	}
+
+	return r->short_read ? -1 : 0;
+}
+
+/* decode count samples that make up all of buf, -1 if it is malformed */
+int push_decode(const void *buf, size_t len, sample_t *batch, int count)
+{
+	push_reader_t r = { buf, (const unsigned char *) buf + len, 0 };
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (push_unpack(&r, &batch[i]) == -1)
+			return -1;
+
+	return r.p == r.end ? 0 : -1;
+}
+
+/* names end up as directories below datadir */
+static
+int push_valid_name(const char *name)
+{
+	const char *p;
+
+	if (str_isempty(name) || str_equal(name, ".") || str_equal(name, ".."))
+		return 0;
+
+	for (p = name; *p; p++)
+		if (*p == '/' || *p == ' ' || *p == '\t' || *p == '\n')
+			return 0;
+
+	return 1;
+}
+
+/* "/path" is a unix socket, everything else is host:port */
+static
+int push_socket(const char *addr, int passive,
+                struct sockaddr_storage *ss, socklen_t *sslen)
+{
+	LOG_TRACEME
+
+	memset(ss, 0, sizeof(*ss));
+
+	if (addr[0] == '/') {
+		struct sockaddr_un *sun = (struct sockaddr_un *) ss;
+
+		sun->sun_family = AF_UNIX;
+		snprintf(sun->sun_path, sizeof(sun->sun_path), "%s", addr);
+
+		*sslen = sizeof(struct sockaddr_un);
+		return socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+
+	char *host = str_dup(addr), *port = strrchr(host, ':');
+	struct addrinfo hints, *res;
+	int fd, rc;
+
+	if (!port) {
+		log_error("Invalid address '%s', expected host:port", addr);
+		mem_free(host);
+		return -1;
+	}
+
+	*port++ = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = passive ? AI_PASSIVE : 0;
+
+	if ((rc = getaddrinfo(str_isempty(host) ? NULL : host, port, &hints, &res)) != 0) {
+		log_error("getaddrinfo(%s): %s", addr, gai_strerror(rc));
+		mem_free(host);
+		return -1;
+	}
+
+	memcpy(ss, res->ai_addr, res->ai_addrlen);
+	*sslen = res->ai_addrlen;
+
+	fd = socket(res->ai_family, SOCK_STREAM, 0);
+
+	freeaddrinfo(res);
+	mem_free(host);
+
+	return fd;
+}
+
+/* forget the collector and everything still queued for it */
+static
+void push_reset(void)
+{
+	LOG_TRACEME
+
+	if (queue_len > 0)
+		log_warn("Dropping %d batches queued for %s", queue_len, target);
+
+	for (; queue_len > 0; queue_len--) {
+		mem_free(queue[queue_head].buf);
+		queue_head = (queue_head + 1) % queue_size;
+	}
+
+	if (sock != -1)
+		close(sock);
+
+	mem_free(queue);
+	mem_free(target);
+	mem_free(host);
+
+	queue      = NULL;
+	target     = NULL;
+	host       = NULL;
+	queue_head = 0;
+	head_off   = 0;
+	sock       = -1;
+	connecting = 0;
+	backoff    = PUSH_BACKOFF_MIN;
+	retry      = 0;
+}
+
+/* may be called again after a reload changed the push options */
+int push_init(void)
+{
+	LOG_TRACEME
+
+	const char *addr = cfg_getstr(cfg, "push");
+
+	push_reset();
+
+	if (str_isempty(addr))
+		return 0;
+
+	queue_size = cfg_getint(cfg, "push_queue");
+
+	if (queue_size < 1)
+		queue_size = 1;
+
+	if (!(queue = mem_alloc(queue_size * sizeof(push_batch_t))))
+		return -1;
+
+	/* the configuration is freed on reload */
+	target = str_dup(addr);
+
+	const char *name = cfg_getstr(cfg, "push_host");
+	char hostname[256];
+
+	if (str_isempty(name)) {
+		if (gethostname(hostname, sizeof(hostname)) == -1) {
+			log_perror("gethostname");
+			return -1;
+		}
+
+		hostname[sizeof(hostname) - 1] = '\0';
+		name = hostname;
+	}
+
+	if (!push_valid_name(name)) {
+		log_error("Invalid push_host '%s'", name);
+		return -1;
+	}
+
+	host = str_dup(name);
+
+	/* a vanished collector must not kill us on write */
+	signal(SIGPIPE, SIG_IGN);
+
+	return 0;
+}
+
+static
+void push_disconnect(time_t now)
+{
+	LOG_TRACEME
+
+	close(sock);
+	sock = -1;
+	connecting = 0;
+
+	/* resend the interrupted batch from its start */
+	head_off = 0;
+
+	retry   = now + backoff;
+	backoff = backoff * 2 > PUSH_BACKOFF_MAX ? PUSH_BACKOFF_MAX : backoff * 2;
+}
+
+static
+void push_connect(time_t now)
+{
+	LOG_TRACEME
+
+	struct sockaddr_storage ss;
+	socklen_t sslen;
+
+	if (now < retry)
+		return;
+
+	if ((sock = push_socket(target, 0, &ss, &sslen)) == -1) {
+		retry = now + backoff;
+		return;
+	}
+
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+	if (connect(sock, (struct sockaddr *) &ss, sslen) == -1) {
+		if (errno != EINPROGRESS) {
+			log_pwarn("connect(%s)", target);
+			push_disconnect(now);
+			return;
+		}
+
+		connecting = 1;
+	}
+}
+
+/* write as much of the queue as the socket takes without blocking */
+static
+void push_flush(time_t now)
+{
+	LOG_TRACEME
+
+	if (sock == -1)
+		push_connect(now);
+
+	if (sock == -1)
+		return;
+
+	if (connecting) {
+		struct pollfd pfd = { sock, POLLOUT, 0 };
+		int err = 0;
+		socklen_t len = sizeof(err);
+
+		if (poll(&pfd, 1, 0) < 1)
+			return;
+
+		if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err) {
+			log_warn("connect(%s): %s", target, strerror(err));
+			push_disconnect(now);
+			return;
+		}
+
+		log_info("Connected to collector %s", target);
+		connecting = 0;
+		backoff = PUSH_BACKOFF_MIN;
+	}
+
+	while (queue_len > 0) {
+		push_batch_t *b = &queue[queue_head];
+		ssize_t n = write(sock, (char *) b->buf + head_off, b->len - head_off);
+
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				return;
+
+			log_pwarn("write(%s)", target);
+			push_disconnect(now);
+			return;
+		}
+
+		head_off += n;
+
+		if (head_off < b->len)
+			continue;
+
+		mem_free(b->buf);
+		head_off   = 0;
+		queue_head = (queue_head + 1) % queue_size;
+		queue_len--;
+	}
+}
+
+void push_enqueue(sample_t *batch, int count, time_t curtime)
+{
+	LOG_TRACEME
+
+	if (!target || count < 1)
+		return;
+
+	if (queue_len == queue_size) {
+		dropped_batches++;
+		dropped_samples += count;
+
+		if (dropped_batches % 100 == 1)
+			log_warn("Push queue full, dropped %lu batches (%lu samples) so far",
+			         dropped_batches, dropped_samples);
+	}
+
+	else {
+		push_batch_t *b = &queue[(queue_head + queue_len) % queue_size];
+
+		if (!(b->buf = push_pack(batch, count, curtime, &b->len)))
+			return;
+
+		queue_len++;
+	}
+
+	push_flush(curtime);
+}
+
+/* sleep until the next cycle, but keep feeding the collector */
+void push_idle(int seconds)
+{
+	LOG_TRACEME
+
+	time_t until = time(NULL) + seconds, now;
+
+	/* signals cut sleep short, which must not move the next cycle */
+	if (!target) {
+		while ((now = time(NULL)) < until)
+			sleep(until - now);
+
+		return;
+	}
+
+	while ((now = time(NULL)) < until) {
+		if (sock != -1 && queue_len > 0) {
+			struct pollfd pfd = { sock, POLLOUT, 0 };
+
+			poll(&pfd, 1, (until - now) * 1000);
+			push_flush(time(NULL));
+		}
+
+		else {
+			sleep(until - now);
+			push_flush(time(NULL));
+		}
+	}
+}
+
+static
+ssize_t push_readn(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, (char *) buf + done, len - done);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			break;
+
+		done += n;
+	}
+
+	return done;
+}
+
+/* store every batch of one connection below datadir/<host>, returns the
+ * number of samples stored */
+static
+int push_receive_one(int fd)
+{
+	LOG_TRACEME
+
+	unsigned char hdr[PUSH_HDRLEN], *buf = NULL;
+	char sender[256] = "", name[256];
+	int samples = 0, failed = 0;
+	uint32_t i;
+
+	while (push_readn(fd, hdr, PUSH_HDRLEN) == PUSH_HDRLEN) {
+		push_reader_t r = { hdr, hdr + PUSH_HDRLEN, 0 };
+		uint32_t magic   = push_get32(&r);
+		uint16_t version = push_get16(&r);
+		uint16_t hostlen = push_get16(&r);
+		uint32_t len     = push_get32(&r);
+		uint32_t count   = push_get32(&r);
+
+		if (magic != PUSH_MAGIC || version != PUSH_VERSION) {
+			log_error("Unsupported batch (magic %#x, version %u)",
+			          magic, version);
+			break;
+		}
+
+		if (hostlen >= sizeof(name) || len > PUSH_MAXLEN ||
+		    push_readn(fd, name, hostlen) != (ssize_t) hostlen) {
+			log_error("Malformed batch header");
+			break;
+		}
+
+		name[hostlen] = '\0';
+
+		/* the first batch decides where the connection's samples go */
+		if (!sender[0]) {
+			char *datadir = NULL;
+
+			if (!push_valid_name(name)) {
+				log_error("Invalid sender host '%s'", name);
+				break;
+			}
+
+			snprintf(sender, sizeof(sender), "%s", name);
+			asprintf(&datadir, "%s/%s", cfg_getstr(cfg, "datadir"), sender);
+			cfg_setstr(cfg, "datadir", datadir);
+			mem_free(datadir);
+
+			log_info("Receiving samples from %s", sender);
+		}
+
+		else if (!str_equal(name, sender)) {
+			log_error("Sender changed from %s to %s", sender, name);
+			break;
+		}
+
+		unsigned char *p = mem_realloc(buf, len + 1);
+
+		if (!p || push_readn(fd, p, len) != (ssize_t) len) {
+			buf = p ? p : buf;
+			break;
+		}
+
+		buf = p;
+		r.p   = buf;
+		r.end = buf + len;
+
+		for (i = 0; i < count; i++) {
+			sample_t s;
+
+			if (push_unpack(&r, &s) == -1) {
+				log_error("Malformed sample in batch from %s", sender);
+				break;
+			}
+
+			if (!push_valid_name(s.name) || vrrd_store(&s) == -1)
+				failed++;
+			else
+				samples++;
+		}
+	}
+
+	if (failed > 0)
+		log_warn("%d samples from %s could not be stored", failed, sender);
+
+	mem_free(buf);
+	return samples;
+}
+
+/* reference receiver: every connection is handled by its own process,
+ * which stores the received batches like a replayed trace */
+int push_receive(const char *addr)
+{
+	LOG_TRACEME
+
+	struct sockaddr_storage ss;
+	socklen_t sslen;
+	int fd, one = 1;
+
+	if ((fd = push_socket(addr, 1, &ss, &sslen)) == -1) {
+		log_perror("socket(%s)", addr);
+		return -1;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if (addr[0] == '/')
+		unlink(addr);
+
+	if (bind(fd, (struct sockaddr *) &ss, sslen) == -1 || listen(fd, 16) == -1) {
+		log_perror("bind(%s)", addr);
+		close(fd);
+		return -1;
+	}
+
+	/* let the kernel reap the connection handlers */
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_IGN;
+	sa.sa_flags   = SA_NOCLDWAIT;
+	sigaction(SIGCHLD, &sa, NULL);
+
+	log_info("Receiving samples on %s", addr);
+
+	while (1) {
+		int cfd = accept(fd, NULL, NULL);
+
+		if (cfd == -1) {
+			if (errno != EINTR)
+				log_perror("accept");
+
+			continue;
+		}
+
+		switch (fork()) {
+		case -1:
+			log_perror("fork");
+			break;
+
+		case 0:
+			close(fd);
+			log_info("Received %d samples", push_receive_one(cfd));
+			exit(EXIT_SUCCESS);
+
+		default:
+			break;
+		}
+
+		close(cfd);
+	}
+
+	return 0;
+}
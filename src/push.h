@@ -0,0 +1,36 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_PUSH_H
+#define _VSTATD_PUSH_H
+
+#include <stddef.h>
+
+#include "sample.h"
+
+/* smallest encoded sample: id, empty name and no families */
+#define PUSH_SAMPLE_MIN 10
+
+size_t push_size  (const sample_t *s);
+void  *push_encode(void *buf, const sample_t *s);
+int    push_decode(const void *buf, size_t len, sample_t *batch, int count);
+
+int  push_init   (void);
+void push_enqueue(sample_t *batch, int count, time_t curtime);
+void push_idle   (int seconds);
+int  push_receive(const char *addr);
+
+#endif
@@ -0,0 +1,241 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <rrd.h>
+
+#include "cfg.h"
+#include "rate.h"
+
+#include <lucid/log.h>
+#include <lucid/mem.h>
+
+/* open addressing hash keyed by guest name, size is always a power of two */
+static rate_t **RATES = NULL;
+static unsigned int rates_size = 0;
+static unsigned int rates_used = 0;
+
+static time_t swept = 0;
+
+/* FNV-1a */
+static inline
+unsigned int rate_hash(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name) {
+		h ^= (unsigned char) *name++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static
+void rate_insert(rate_t **table, unsigned int size, rate_t *r)
+{
+	unsigned int i = rate_hash(r->name) & (size - 1);
+
+	while (table[i])
+		i = (i + 1) & (size - 1);
+
+	table[i] = r;
+}
+
+static
+int rate_resize(unsigned int size)
+{
+	LOG_TRACEME
+
+	rate_t **table = mem_alloc(size * sizeof(rate_t *));
+	unsigned int i;
+
+	if (!table)
+		return -1;
+
+	memset(table, 0, size * sizeof(rate_t *));
+
+	for (i = 0; i < rates_size; i++)
+		if (RATES[i])
+			rate_insert(table, size, RATES[i]);
+
+	mem_free(RATES);
+
+	RATES      = table;
+	rates_size = size;
+
+	return 0;
+}
+
+/* schema used for files that do not exist yet */
+int rate_create_schema(void)
+{
+	const char *schema = cfg_getstr(cfg, "schema");
+
+	return schema && strcmp(schema, "rate") == 0 ? SCHEMA_RATE : SCHEMA_RAW;
+}
+
+/* the data directory changed, files have to be looked at again */
+void rate_forget_schemas(void)
+{
+	LOG_TRACEME
+
+	unsigned int i;
+
+	for (i = 0; i < rates_size; i++) {
+		if (!RATES[i])
+			continue;
+
+		memset(RATES[i]->cacct_schema, SCHEMA_UNKNOWN, sizeof(RATES[i]->cacct_schema));
+		memset(RATES[i]->limit_schema, SCHEMA_UNKNOWN, sizeof(RATES[i]->limit_schema));
+	}
+}
+
+/* counters of a guest that was not stored for two heartbeats are of no
+ * use for a delta anymore, so entries of departed guests go away */
+void rate_sweep(time_t now)
+{
+	LOG_TRACEME
+
+	time_t ttl = 2 * atoi(HEARTBEAT);
+	unsigned int i, removed = 0;
+
+	swept = now;
+
+	for (i = 0; i < rates_size; i++) {
+		if (RATES[i] && now - RATES[i]->seen > ttl) {
+			mem_free(RATES[i]);
+			RATES[i] = NULL;
+			rates_used--;
+			removed++;
+		}
+	}
+
+	/* linear probing does not support holes, so rebuild the table */
+	if (removed > 0)
+		rate_resize(rates_size);
+}
+
+/* bytes held by the table and its entries */
+size_t rate_footprint(void)
+{
+	return rates_size * sizeof(rate_t *) + rates_used * sizeof(rate_t);
+}
+
+rate_t *rate_get(const char *name)
+{
+	LOG_TRACEME
+
+	time_t now = time(NULL);
+	unsigned int i;
+
+	if (now - swept >= STEP)
+		rate_sweep(now);
+
+	if (rates_size > 0) {
+		i = rate_hash(name) & (rates_size - 1);
+
+		for (; RATES[i]; i = (i + 1) & (rates_size - 1)) {
+			if (strcmp(RATES[i]->name, name) == 0) {
+				RATES[i]->seen = now;
+				return RATES[i];
+			}
+		}
+	}
+
+	/* keep the load factor below 1/2 */
+	if ((rates_used + 1) * 2 > rates_size &&
+	    rate_resize(rates_size ? rates_size * 2 : 64) == -1)
+		return NULL;
+
+	rate_t *r = mem_alloc(sizeof(rate_t));
+
+	if (!r)
+		return NULL;
+
+	memset(r, 0, sizeof(rate_t));
+	memset(r->cacct_schema, SCHEMA_UNKNOWN, sizeof(r->cacct_schema));
+	memset(r->limit_schema, SCHEMA_UNKNOWN, sizeof(r->limit_schema));
+
+	snprintf(r->name, SAMPLE_NAMELEN, "%s", name);
+	r->seen = now;
+
+	rate_insert(RATES, rates_size, r);
+	rates_used++;
+
+	return r;
+}
+
+/* a file uses the rate schema if it has the data source only that schema
+ * defines; the answer is cached since rrd_info reads the whole header */
+int rate_schema(char *path, const char *ds, signed char *cache)
+{
+	LOG_TRACEME
+
+	rrd_info_t *info, *p;
+	char key[64];
+
+	if (*cache != SCHEMA_UNKNOWN)
+		return *cache;
+
+	if ((info = rrd_info_r(path)) == NULL) {
+		log_error("rrd_info(%s): %s", path, rrd_get_error());
+		rrd_clear_error();
+		return SCHEMA_RAW;
+	}
+
+	snprintf(key, sizeof(key), "ds[%s].index", ds);
+
+	*cache = SCHEMA_RAW;
+
+	for (p = info; p; p = p->next)
+		if (strcmp(p->key, key) == 0)
+			*cache = SCHEMA_RATE;
+
+	rrd_info_free(info);
+	return *cache;
+}
+
+/* difference between two readings of a counter; packet counts are 32 bit
+ * in the kernel and wrap, anything else going backwards is a reset after
+ * the context was restarted and has no meaningful delta */
+int rate_delta(uint64_t cur, uint64_t prev, uint64_t *delta)
+{
+	if (cur >= prev) {
+		*delta = cur - prev;
+		return 0;
+	}
+
+	if (prev <= UINT32_MAX && prev > UINT32_MAX / 2 && cur < UINT32_MAX / 2) {
+		*delta = cur + ((uint64_t) UINT32_MAX + 1) - prev;
+		return 0;
+	}
+
+	return -1;
+}
+
+/* num * scale / den as an rrd_update value, unknown if invalid */
+void rate_fmt(char *buf, int valid, uint64_t num, uint64_t den, int scale)
+{
+	if (!valid || den == 0)
+		snprintf(buf, RATE_BUFLEN, "U");
+	else
+		snprintf(buf, RATE_BUFLEN, "%.3f", (double) num * scale / den);
+}
@@ -0,0 +1,58 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_RATE_H
+#define _VSTATD_RATE_H
+
+#include "sample.h"
+
+/* layout of an rrd file: raw counters as written by older versions or
+ * per-second rates and derived values */
+enum {
+	SCHEMA_UNKNOWN = -1,
+	SCHEMA_RAW,
+	SCHEMA_RATE,
+};
+
+#define RATE_BUFLEN 32
+
+/* previous counters of one guest, keyed by name since samples pushed
+ * from several hosts may share xids */
+typedef struct {
+	char name[SAMPLE_NAMELEN];
+	time_t seen;
+	time_t cacct_time;
+	struct {
+		uint64_t recvp, recvb, sendp, sendb, failp, failb;
+	} cacct[CACCT_NR];
+	time_t sched_time;
+	struct {
+		uint64_t user, system, hold;
+	} sched;
+	signed char cacct_schema[CACCT_NR];
+	signed char limit_schema[LIMIT_NR];
+} rate_t;
+
+int     rate_create_schema (void);
+void    rate_forget_schemas(void);
+rate_t *rate_get   (const char *name);
+void    rate_sweep (time_t now);
+size_t  rate_footprint(void);
+int     rate_schema(char *path, const char *ds, signed char *cache);
+int     rate_delta (uint64_t cur, uint64_t prev, uint64_t *delta);
+void    rate_fmt   (char *buf, int valid, uint64_t num, uint64_t den, int scale);
+
+#endif
@@ -0,0 +1,313 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/wait.h>
+
+#include "cfg.h"
+#include "rule.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/printf.h>
+
+cfg_opt_t RULE_OPTS[] = {
+	CFG_STR("metric", NULL, CFGF_NONE),
+	CFG_STR("guest",  NULL, CFGF_NONE),
+	CFG_INT("above",  0,    CFGF_NONE),
+	CFG_INT("clear",  -1,   CFGF_NONE),
+	CFG_INT("for",    0,    CFGF_NONE),
+	CFG_END()
+};
+
+#define METRIC(name, member) { name, offsetof(sample_t, member), -1 }
+
+#define LIMIT_METRIC(db, idx) \
+	METRIC(db ":cur", limit[idx].cur), \
+	METRIC(db ":max", limit[idx].max), \
+	{ db ":util", offsetof(sample_t, limit[idx].cur), idx }
+
+/* values a rule can watch, named like the rrd files and data sources
+ * they end up in */
+static
+struct rule_metric {
+	const char *name;
+	size_t offset;
+	int limit;
+} METRICS[] = {
+	METRIC("sys_LOADAVG:1MIN",      loadavg[LOADAVG_1MIN]),
+	METRIC("sys_LOADAVG:5MIN",      loadavg[LOADAVG_5MIN]),
+	METRIC("sys_LOADAVG:15MIN",     loadavg[LOADAVG_15MIN]),
+	METRIC("thread_TOTAL:value",    cvirt[CVIRT_TOTAL]),
+	METRIC("thread_RUNNING:value",  cvirt[CVIRT_RUNNING]),
+	METRIC("thread_UNINTR:value",   cvirt[CVIRT_UNINTR]),
+	METRIC("thread_ONHOLD:value",   cvirt[CVIRT_ONHOLD]),
+	LIMIT_METRIC("mem_AS",          LIMIT_AS),
+	LIMIT_METRIC("file_LOCKS",      LIMIT_LOCKS),
+	LIMIT_METRIC("mem_MEMLOCK",     LIMIT_MEMLOCK),
+	LIMIT_METRIC("ipc_MSGQUEUE",    LIMIT_MSGQUEUE),
+	LIMIT_METRIC("file_NOFILE",     LIMIT_NOFILE),
+	LIMIT_METRIC("sys_NPROC",       LIMIT_NPROC),
+	LIMIT_METRIC("mem_RSS",         LIMIT_RSS),
+	LIMIT_METRIC("mem_ANON",        LIMIT_ANON),
+	LIMIT_METRIC("file_DENTRY",     LIMIT_DENTRY),
+	LIMIT_METRIC("sys_MAPPED",      LIMIT_MAPPED),
+	LIMIT_METRIC("ipc_NSEMS",       LIMIT_NSEMS),
+	LIMIT_METRIC("file_NSOCK",      LIMIT_NSOCK),
+	LIMIT_METRIC("file_OPENFD",     LIMIT_OPENFD),
+	LIMIT_METRIC("ipc_SEMARY",      LIMIT_SEMARY),
+	LIMIT_METRIC("ipc_SHMEM",       LIMIT_SHMEM),
+	{ NULL, 0, -1 }
+};
+
+typedef struct {
+	const char *name;
+	const char *metric;
+	const char *guest;
+	size_t offset;
+	int limit;
+	uint64_t above;
+	uint64_t clear;
+	time_t duration;
+} rule_t;
+
+static rule_t *RULES = NULL;
+static int nrules = 0;
+
+static const char *alert_fifo = NULL;
+static const char *alert_exec = NULL;
+
+/* may be called again after a reload, the rules are then rebuilt from the
+ * new configuration and stay disabled if it is invalid */
+int rule_init(void)
+{
+	LOG_TRACEME
+
+	int i, j, n;
+
+	mem_free(RULES);
+	RULES  = NULL;
+	nrules = 0;
+
+	alert_fifo = cfg_getstr(cfg, "alert_fifo");
+	alert_exec = cfg_getstr(cfg, "alert_exec");
+
+	n = cfg_size(cfg, "rule");
+
+	if (n < 1)
+		return 0;
+
+	if (!(RULES = mem_alloc(n * sizeof(rule_t))))
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		cfg_t *sec = cfg_getnsec(cfg, "rule", i);
+		rule_t *r  = &RULES[i];
+		long clear = cfg_getint(sec, "clear");
+
+		r->name     = cfg_title(sec);
+		r->metric   = cfg_getstr(sec, "metric");
+		r->guest    = cfg_getstr(sec, "guest");
+		r->above    = cfg_getint(sec, "above");
+		r->clear    = clear < 0 ? r->above : (uint64_t) clear;
+		r->duration = cfg_getint(sec, "for");
+
+		for (j = 0; METRICS[j].name; j++)
+			if (r->metric && strcmp(r->metric, METRICS[j].name) == 0)
+				break;
+
+		if (!METRICS[j].name) {
+			log_error("Unknown metric '%s' in rule %s", r->metric, r->name);
+			errno = EINVAL;
+			return -1;
+		}
+
+		r->offset = METRICS[j].offset;
+		r->limit  = METRICS[j].limit;
+
+		if (r->clear > r->above) {
+			log_error("clear is above the threshold in rule %s", r->name);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	nrules = n;
+
+	log_debug("Evaluating %d rules", nrules);
+	return 0;
+}
+
+/* run the hook in a grandchild, so nothing is left to reap */
+static
+void rule_exec(const rule_t *r, const char *guest, uint64_t value, int firing)
+{
+	LOG_TRACEME
+
+	char buf[32];
+	pid_t pid;
+
+	snprintf(buf, sizeof(buf), "%" PRIu64, value);
+
+	switch ((pid = fork())) {
+	case -1:
+		log_perror("fork");
+		return;
+
+	case 0:
+		if (fork() == 0) {
+			execl(alert_exec, alert_exec, firing ? "firing" : "clear",
+			      r->name, guest, r->metric, buf, (char *) NULL);
+			_exit(EXIT_FAILURE);
+		}
+
+		_exit(EXIT_SUCCESS);
+
+	default:
+		waitpid(pid, NULL, 0);
+		break;
+	}
+}
+
+static
+void rule_alert(const rule_t *r, const char *guest, time_t t,
+                uint64_t value, int firing)
+{
+	LOG_TRACEME
+
+	if (firing)
+		log_warn("Rule %s firing for guest %s: %s = %" PRIu64 " >= %" PRIu64,
+		         r->name, guest, r->metric, value, r->above);
+	else
+		log_info("Rule %s cleared for guest %s: %s = %" PRIu64,
+		         r->name, guest, r->metric, value);
+
+	/* a fifo without reader drops the alert instead of blocking */
+	if (alert_fifo) {
+		int fd = open(alert_fifo, O_WRONLY|O_NONBLOCK);
+
+		if (fd != -1) {
+			dprintf(fd, "%ld %s %s %s %s %" PRIu64 "\n",
+			        (long) t, firing ? "firing" : "clear",
+			        r->name, guest, r->metric, value);
+			close(fd);
+		}
+	}
+
+	if (alert_exec)
+		rule_exec(r, guest, value, firing);
+}
+
+/* cur in percent of the configured limit, none for unlimited ones; the
+ * limits are cached per guest by limit_hard */
+static
+int rule_util(int i, const sample_t *s, uint64_t *value)
+{
+	uint64_t max = s->limit_hard[i];
+
+	if (max == 0 || max == SAMPLE_UNKNOWN)
+		return -1;
+
+	*value = s->limit[i].cur * 100 / max;
+	return 0;
+}
+
+/* threshold with duration and hysteresis: a rule fires once the value
+ * stayed at or above the threshold for the given time and clears once it
+ * dropped below the clear level */
+void rule_eval(int g, const sample_t *s)
+{
+	LOG_TRACEME
+
+	time_t now = s->cvirt_time;
+	rule_state_t *states;
+	int i;
+
+	if (nrules < 1 || !(states = guest_rules(g, nrules)))
+		return;
+
+	for (i = 0; i < nrules; i++) {
+		const rule_t *r = &RULES[i];
+		rule_state_t *st = &states[i];
+		uint64_t value;
+
+		if (r->guest && strcmp(r->guest, s->name) != 0)
+			continue;
+
+		memcpy(&value, (const char *) s + r->offset, sizeof(value));
+
+		if (value == SAMPLE_UNKNOWN)
+			continue;
+
+		if (r->limit != -1 && rule_util(r->limit, s, &value) == -1)
+			continue;
+
+		if (st->firing) {
+			if (value < r->clear) {
+				st->firing = 0;
+				st->since  = 0;
+				rule_alert(r, s->name, now, value, 0);
+			}
+		}
+
+		else if (value >= r->above) {
+			if (!st->since)
+				st->since = now;
+
+			if (now - st->since >= r->duration) {
+				st->firing = 1;
+				rule_alert(r, s->name, now, value, 1);
+			}
+		}
+
+		else
+			st->since = 0;
+	}
+}
+
+/* guests that disappeared while a rule was firing for them are cleared
+ * before guest_sweep drops their states */
+void rule_sweep(unsigned int cycle)
+{
+	LOG_TRACEME
+
+	time_t now = time(NULL);
+	unsigned int slot;
+	int i;
+
+	for (slot = 0; slot < GUESTS.used; slot++) {
+		rule_state_t *states = GUESTS.rules[slot];
+
+		if (!states || !GUESTS.live[slot] || GUESTS.cycle[slot] == cycle)
+			continue;
+
+		for (i = 0; i < nrules; i++) {
+			if (!states[i].firing)
+				continue;
+
+			states[i].firing = 0;
+			rule_alert(&RULES[i], GUESTS.name[slot], now, 0, 0);
+		}
+	}
+}
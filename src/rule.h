@@ -0,0 +1,37 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_RULE_H
+#define _VSTATD_RULE_H
+
+#include <confuse.h>
+
+#include "guest.h"
+#include "sample.h"
+
+/* evaluation state of one rule for one guest */
+typedef struct rule_state {
+	time_t since;
+	int firing;
+} rule_state_t;
+
+extern cfg_opt_t RULE_OPTS[];
+
+int  rule_init(void);
+void rule_eval(int g, const sample_t *s);
+void rule_sweep(unsigned int cycle);
+
+#endif
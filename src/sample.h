@@ -0,0 +1,144 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_SAMPLE_H
+#define _VSTATD_SAMPLE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* indices into the per-collector tables, keep in sync with
+ * CACCT[], CVIRT[], LIMIT[], LOADAVG[] and BURST[] */
+enum {
+	CACCT_UNSPEC,
+	CACCT_UNIX,
+	CACCT_INET,
+	CACCT_INET6,
+	CACCT_PACKET,
+	CACCT_OTHER,
+	CACCT_NR
+};
+
+enum {
+	CVIRT_TOTAL,
+	CVIRT_RUNNING,
+	CVIRT_UNINTR,
+	CVIRT_ONHOLD,
+	CVIRT_NR
+};
+
+enum {
+	LIMIT_AS,
+	LIMIT_LOCKS,
+	LIMIT_MEMLOCK,
+	LIMIT_MSGQUEUE,
+	LIMIT_NOFILE,
+	LIMIT_NPROC,
+	LIMIT_RSS,
+	LIMIT_ANON,
+	LIMIT_DENTRY,
+	LIMIT_MAPPED,
+	LIMIT_NSEMS,
+	LIMIT_NSOCK,
+	LIMIT_OPENFD,
+	LIMIT_SEMARY,
+	LIMIT_SHMEM,
+	LIMIT_NR
+};
+
+enum {
+	LOADAVG_1MIN,
+	LOADAVG_5MIN,
+	LOADAVG_15MIN,
+	LOADAVG_NR
+};
+
+enum {
+	BURST_RUNNING,
+	BURST_UNINTR,
+	BURST_NET,
+	BURST_NR
+};
+
+#define SAMPLE_NAMELEN 65
+
+/* value of a counter that was not collected: cvirt counters and limits
+ * a backend does not have, whose files are neither created nor updated,
+ * and burst metrics without samples, which are written as unknown */
+#define SAMPLE_UNKNOWN UINT64_MAX
+
+/* everything fetched for one guest in one cycle; the counters of every
+ * family are uint64_t only, push.c sends each family as a flat array */
+typedef struct {
+	uint64_t id;
+	char name[SAMPLE_NAMELEN];
+
+	time_t cacct_time;
+	time_t cvirt_time;
+	time_t limit_time;
+	time_t loadavg_time;
+	time_t cgroup_time;
+	time_t sched_time;
+	time_t dlimit_time;
+	time_t burst_time;
+
+	struct {
+		uint64_t recvp, recvb;
+		uint64_t sendp, sendb;
+		uint64_t failp, failb;
+	} cacct[CACCT_NR];
+
+	uint64_t cvirt[CVIRT_NR];
+
+	struct {
+		uint64_t min, cur, max;
+	} limit[LIMIT_NR];
+
+	/* configured hard limits, 0 if unlimited */
+	uint64_t limit_hard[LIMIT_NR];
+
+	uint64_t loadavg[LOADAVG_NR];
+
+	/* summed over all cpus */
+	struct {
+		uint64_t user, system, hold;
+		uint64_t tokens, tokens_max, onhold;
+	} sched;
+
+	/* summed over all configured mount points, space in KiB */
+	struct {
+		uint64_t space_used, space_total;
+		uint64_t inodes_used, inodes_total;
+	} dlimit;
+
+	/* cgroup v2 backend only */
+	struct {
+		uint64_t user, system, throttled;
+	} cpu;
+
+	struct {
+		uint64_t rbytes, wbytes, rios, wios;
+	} io;
+
+	/* spread of the sub-step samples taken since the last cycle, the
+	 * network traffic in bytes per second; SAMPLE_UNKNOWN for a metric
+	 * nothing was sampled for */
+	struct {
+		uint64_t min, max, p99;
+	} burst[BURST_NR];
+} sample_t;
+
+#endif
@@ -0,0 +1,233 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <rrd.h>
+
+#include "cfg.h"
+#include "rate.h"
+#include "vrrd.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/misc.h>
+#include <lucid/printf.h>
+
+/* sum the per-cpu lines of /proc/virtual/<xid>/sched:
+ * cpu N: user sys hold token_time idle_time flags tokens tmin tmax ... */
+int sched_parse(sample_t *s, char *buf)
+{
+	char *line, *next;
+	int cpus = 0;
+
+	memset(&s->sched, 0, sizeof(s->sched));
+
+	for (line = buf; line; line = next) {
+		uint64_t user, sys, hold;
+		long token_time, idle_time;
+		int cpu, tokens, tmin, tmax;
+		char flags[3];
+
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+
+		if (sscanf(line, "cpu %d: %" SCNu64 " %" SCNu64 " %" SCNu64
+		           " %ld %ld %2s %d %d %d",
+		           &cpu, &user, &sys, &hold, &token_time, &idle_time,
+		           flags, &tokens, &tmin, &tmax) != 10)
+			continue;
+
+		s->sched.user       += user;
+		s->sched.system     += sys;
+		s->sched.hold       += hold;
+		s->sched.tokens     += tokens;
+		s->sched.tokens_max += tmax;
+
+		if (flags[0] == 'H')
+			s->sched.onhold++;
+
+		cpus++;
+	}
+
+	return cpus > 0 ? 0 : -1;
+}
+
+/* one read per guest; kernels without the file just lack the family */
+int sched_fetch(xid_t xid, sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *procdir = cfg_getstr(cfg, "procdir");
+	char path[PATH_MAX], buf[8192];
+	ssize_t len;
+	int fd;
+
+	s->sched_time = 0;
+
+	snprintf(path, sizeof(path), "%s/%d/sched", procdir, xid);
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		if (errno != ENOENT)
+			log_perror("open(%s)", path);
+
+		return -1;
+	}
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+
+	if (len == -1) {
+		log_perror("read(%s)", path);
+		return -1;
+	}
+
+	buf[len] = '\0';
+
+	if (sched_parse(s, buf) == -1)
+		return -1;
+
+	s->sched_time = time(NULL);
+	return 0;
+}
+
+static
+int sched_rrd_create(char *path, char **ds)
+{
+	LOG_TRACEME
+
+	char timestr[32];
+	time_t curtime = vrrd_begin();
+
+	char *argv[] = {
+		"create", path, "-b", timestr, "-s", STEP_STR,
+		ds[0], ds[1], ds[2],
+		RRA_DEFAULT
+	};
+
+	int argc = sizeof(argv) / sizeof(*argv);
+
+	snprintf(timestr, 32, "%ld", curtime - STEP - (curtime % STEP));
+
+	if (mkdirnamep(path, 0700) == -1) {
+		log_perror("mkdirnamep(%s)", path);
+		return -1;
+	}
+
+	if (rrd_create(argc, argv) == -1) {
+		log_error("rrd_create(%s): %s", path, rrd_get_error());
+		rrd_clear_error();
+		return -1;
+	}
+
+	return 0;
+}
+
+/* cpu time in ticks per second */
+static char *CPU_DS[] = {
+	"DS:user:GAUGE:"   HEARTBEAT ":0:U",
+	"DS:system:GAUGE:" HEARTBEAT ":0:U",
+	"DS:hold:GAUGE:"   HEARTBEAT ":0:U",
+};
+
+static char *TOKENS_DS[] = {
+	"DS:tokens:GAUGE:" HEARTBEAT ":0:U",
+	"DS:max:GAUGE:"    HEARTBEAT ":0:U",
+	"DS:onhold:GAUGE:" HEARTBEAT ":0:U",
+};
+
+int sched_rrd_check(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	char *cpu = NULL, *tokens = NULL;
+	int rc = 0;
+
+	asprintf(&cpu,    "%s/%s/sched_CPU.rrd",    datadir, s->name);
+	asprintf(&tokens, "%s/%s/sched_TOKENS.rrd", datadir, s->name);
+
+	if ((!isfile(cpu)    && sched_rrd_create(cpu, CPU_DS) == -1) ||
+	    (!isfile(tokens) && sched_rrd_create(tokens, TOKENS_DS) == -1))
+		rc = -1;
+
+	mem_free(cpu);
+	mem_free(tokens);
+
+	return rc;
+}
+
+int sched_rrd_update(sample_t *s)
+{
+	LOG_TRACEME
+
+	const char *datadir = cfg_getstr(cfg, "datadir");
+	rate_t *r = rate_get(s->name), last;
+	char *buf = NULL, v[3][RATE_BUFLEN];
+	uint64_t d = 0;
+	time_t dt;
+	int i;
+
+	if (!r)
+		return -1;
+
+	last = *r;
+	dt   = last.sched_time ? s->sched_time - last.sched_time : 0;
+
+	if (s->sched_time > r->sched_time) {
+		r->sched_time = s->sched_time;
+		memcpy(&r->sched, &s->sched, sizeof(r->sched));
+	}
+
+	uint64_t cur[3]  = { s->sched.user, s->sched.system, s->sched.hold };
+	uint64_t prev[3] = { last.sched.user, last.sched.system, last.sched.hold };
+
+	for (i = 0; i < 3; i++) {
+		int valid = dt > 0 && rate_delta(cur[i], prev[i], &d) == 0;
+		rate_fmt(v[i], valid, d, dt, 1);
+	}
+
+	asprintf(&buf,
+		"update %s/%s/sched_CPU.rrd %ld:%s:%s:%s",
+		datadir,
+		s->name,
+		vrrd_align_time(s->sched_time),
+		v[0], v[1], v[2]);
+
+	int rc = vrrd_update(s->name, buf);
+
+	buf = NULL;
+
+	asprintf(&buf,
+		"update %s/%s/sched_TOKENS.rrd %ld:%" PRIu64 ":%" PRIu64 ":%" PRIu64,
+		datadir,
+		s->name,
+		vrrd_align_time(s->sched_time),
+		s->sched.tokens,
+		s->sched.tokens_max,
+		s->sched.onhold);
+
+	if (vrrd_update(s->name, buf) == -1)
+		rc = -1;
+
+	return rc;
+}
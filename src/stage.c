@@ -0,0 +1,347 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "cfg.h"
+#include "stage.h"
+#include "vrrd.h"
+
+#include <lucid/log.h>
+
+/* The fetch stage (the main process) pushes samples into a single
+ * producer single consumer ring in shared memory, the persist stage (a
+ * child process with its own rrd and lucid state) drains it. head and
+ * tail only ever grow and are each written by one side only. */
+typedef struct {
+	uint64_t head;
+	uint64_t tail;
+	int waiting;
+
+	/* persist stage statistics */
+	uint64_t persist_ns;
+	uint64_t persisted;
+} stage_shm_t;
+
+static stage_shm_t *shm = NULL;
+static size_t shm_len = 0;
+static sample_t *ring = NULL;
+static uint64_t ring_size = 0;
+static pid_t persist = -1;
+
+/* set by SIGHUP in the persist stage */
+static volatile sig_atomic_t hup = 0;
+static stage_cb_t reopen_log = NULL;
+
+/* doorbell wakes the persist stage, ack wakes a blocked fetch stage */
+static int doorbell[2] = { -1, -1 };
+static int ack[2] = { -1, -1 };
+
+/* fetch stage statistics */
+static uint64_t stalls = 0, maxdepth = 0;
+
+/* every process forked while the stage runs, like the archive task and
+ * the tar and alert hooks, drops the fetch stage's ends of the pipes;
+ * otherwise the persist stage never sees the end of the doorbell and
+ * stage_stop waits for it forever */
+static
+void stage_atfork(void)
+{
+	if (doorbell[1] != -1)
+		close(doorbell[1]);
+
+	if (ack[0] != -1)
+		close(ack[0]);
+
+	doorbell[1] = ack[0] = -1;
+}
+
+#define LOAD(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+static
+uint64_t stage_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+void stage_sighup(int sig)
+{
+	hup = 1;
+}
+
+static
+void stage_persist(void)
+{
+	LOG_TRACEME
+
+	char c;
+	uint64_t tail = LOAD(&shm->tail);
+	struct sigaction sa;
+
+	/* restarted syscalls keep librrd going, the log is reopened once the
+	 * next cycle rings the doorbell */
+	sa.sa_handler = stage_sighup;
+	sa.sa_flags   = SA_RESTART;
+
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction(SIGHUP, &sa, NULL) == -1)
+		log_perror_and_die("sigaction(SIGHUP)");
+
+	log_debug("Persist stage running with %" PRIu64 " slots", ring_size);
+
+	while (1) {
+		if (hup) {
+			hup = 0;
+
+			if (reopen_log)
+				reopen_log();
+		}
+
+		while (tail < LOAD(&shm->head)) {
+			uint64_t start = stage_ns();
+
+			vrrd_store(&ring[tail % ring_size]);
+
+			STORE(&shm->tail, ++tail);
+
+			/* published before looking at waiting, pairs with the
+			 * fetch stage storing waiting before looking at tail */
+			if (LOAD(&shm->waiting)) {
+				STORE(&shm->waiting, 0);
+				write(ack[1], "", 1);
+			}
+
+			STORE(&shm->persist_ns, LOAD(&shm->persist_ns) + stage_ns() - start);
+			STORE(&shm->persisted, LOAD(&shm->persisted) + 1);
+		}
+
+		ssize_t n = read(doorbell[0], &c, 1);
+
+		/* the fetch stage went away and everything is drained */
+		if (n == 0)
+			exit(EXIT_SUCCESS);
+
+		if (n == -1 && errno != EINTR)
+			log_perror_and_die("read(doorbell)");
+	}
+}
+
+/* SIGHUP has to be handled before, the persist stage inherits the
+ * handler until it has installed its own */
+int stage_init(stage_cb_t reopen)
+{
+	LOG_TRACEME
+
+	reopen_log = reopen;
+
+	if (!cfg_getbool(cfg, "pipeline"))
+		return 0;
+
+	ring_size = cfg_getint(cfg, "pipeline_ring");
+
+	if (ring_size < 1)
+		ring_size = 1;
+
+	size_t len = sizeof(stage_shm_t) + ring_size * sizeof(sample_t);
+	void *p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		log_perror("mmap");
+		return -1;
+	}
+
+	shm     = p;
+	shm_len = len;
+	ring    = (sample_t *) (shm + 1);
+
+	if (pipe(doorbell) == -1 || pipe(ack) == -1) {
+		log_perror("pipe");
+		stage_stop();
+		return -1;
+	}
+
+	/* a dead persist stage is noticed on write instead of killing us */
+	signal(SIGPIPE, SIG_IGN);
+
+	static int atfork = 0;
+
+	if (!atfork && pthread_atfork(NULL, NULL, stage_atfork) != 0) {
+		log_error("pthread_atfork failed");
+		stage_stop();
+		return -1;
+	}
+
+	atfork = 1;
+
+	/* a full doorbell just means the persist stage has work queued */
+	fcntl(doorbell[1], F_SETFL, fcntl(doorbell[1], F_GETFL) | O_NONBLOCK);
+	fcntl(ack[1], F_SETFL, fcntl(ack[1], F_GETFL) | O_NONBLOCK);
+
+	switch ((persist = fork())) {
+	case -1:
+		log_perror("fork");
+		stage_stop();
+		return -1;
+
+	case 0:
+		/* stage_atfork closed the fetch stage's ends */
+		stage_persist();
+		exit(EXIT_SUCCESS);
+
+	default:
+		close(doorbell[0]);
+		close(ack[1]);
+		doorbell[0] = ack[1] = -1;
+		break;
+	}
+
+	return 0;
+}
+
+void stage_store(sample_t *s)
+{
+	LOG_TRACEME
+
+	if (!shm) {
+		vrrd_store(s);
+		return;
+	}
+
+	uint64_t head = LOAD(&shm->head);
+	char c;
+
+	/* backpressure: wait for the persist stage to free a slot */
+	while (head - LOAD(&shm->tail) >= ring_size) {
+		STORE(&shm->waiting, 1);
+
+		if (head - LOAD(&shm->tail) < ring_size)
+			break;
+
+		stalls++;
+		write(doorbell[1], "", 1);
+
+		if (read(ack[0], &c, 1) == 0)
+			log_error_and_die("Persist stage died");
+	}
+
+	ring[head % ring_size] = *s;
+	STORE(&shm->head, head + 1);
+
+	if (head + 1 - LOAD(&shm->tail) > maxdepth)
+		maxdepth = head + 1 - LOAD(&shm->tail);
+}
+
+/* the cycle's batch is complete, wake the persist stage and report */
+void stage_commit(long fetch_ms)
+{
+	LOG_TRACEME
+
+	if (!shm) {
+		log_debug("fetch %ld ms", fetch_ms);
+		return;
+	}
+
+	if (write(doorbell[1], "", 1) == -1 && errno == EPIPE)
+		log_error_and_die("Persist stage died");
+
+	uint64_t persisted = LOAD(&shm->persisted);
+	uint64_t persist_ns = LOAD(&shm->persist_ns);
+
+	log_debug("fetch %ld ms, backlog %" PRIu64 "/%" PRIu64 " (max %" PRIu64 "), "
+	          "%" PRIu64 " stalls, persist %" PRIu64 " us/sample",
+	          fetch_ms, LOAD(&shm->head) - LOAD(&shm->tail), ring_size,
+	          maxdepth, stalls,
+	          persisted ? persist_ns / persisted / 1000 : 0);
+}
+
+/* pass a SIGHUP on to the persist stage, a signal sent to the pid file's
+ * process does not reach it */
+void stage_reopen(void)
+{
+	LOG_TRACEME
+
+	if (persist != -1 && kill(persist, SIGHUP) == -1)
+		log_perror("kill(%d, SIGHUP)", persist);
+}
+
+/* position after the last sample handed to the persist stage */
+uint64_t stage_mark(void)
+{
+	LOG_TRACEME
+
+	return shm ? LOAD(&shm->head) : 0;
+}
+
+/* the persist stage publishes how far it got in tail, so everything
+ * before mark is in the RRDs once tail has reached it */
+int stage_persisted(uint64_t mark)
+{
+	LOG_TRACEME
+
+	return !shm || LOAD(&shm->tail) >= mark;
+}
+
+/* the persist stage sees the end of the doorbell once it has drained the
+ * ring and exits, after which stage_init may start a new one */
+void stage_stop(void)
+{
+	LOG_TRACEME
+
+	int i;
+
+	if (!shm)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		if (doorbell[i] != -1)
+			close(doorbell[i]);
+
+		doorbell[i] = -1;
+	}
+
+	if (persist != -1)
+		while (waitpid(persist, NULL, 0) == -1 && errno == EINTR);
+
+	for (i = 0; i < 2; i++) {
+		if (ack[i] != -1)
+			close(ack[i]);
+
+		ack[i] = -1;
+	}
+
+	munmap(shm, shm_len);
+
+	shm      = NULL;
+	ring     = NULL;
+	persist  = -1;
+	stalls   = 0;
+	maxdepth = 0;
+}
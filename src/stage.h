@@ -0,0 +1,35 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#ifndef _VSTATD_STAGE_H
+#define _VSTATD_STAGE_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/* reopens the log of the persist stage after a SIGHUP */
+typedef void (*stage_cb_t)(void);
+
+int      stage_init     (stage_cb_t reopen);
+void     stage_store    (sample_t *s);
+void     stage_commit   (long fetch_ms);
+void     stage_reopen   (void);
+uint64_t stage_mark     (void);
+int      stage_persisted(uint64_t mark);
+void     stage_stop     (void);
+
+#endif
@@ -0,0 +1,270 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "topk.h"
+
+#define _LUCID_PRINTF_MACROS
+#include <lucid/log.h>
+#include <lucid/mem.h>
+#include <lucid/open.h>
+#include <lucid/printf.h>
+#include <lucid/str.h>
+
+typedef struct {
+	uint64_t value;
+	char name[SAMPLE_NAMELEN];
+} topk_entry_t;
+
+static
+int topk_rate(uint64_t cur, uint64_t prev, time_t curtime, time_t prevtime,
+              uint64_t *value)
+{
+	/* counters went backwards, i.e. the context was restarted */
+	if (cur < prev || curtime <= prevtime)
+		return -1;
+
+	*value = (cur - prev) / (curtime - prevtime);
+	return 0;
+}
+
+static
+int topk_load1(const sample_t *s, int last, uint64_t *value)
+{
+	*value = s->loadavg[LOADAVG_1MIN];
+	return 0;
+}
+
+static
+int topk_running(const sample_t *s, int last, uint64_t *value)
+{
+	*value = s->cvirt[CVIRT_RUNNING];
+	return *value == SAMPLE_UNKNOWN ? -1 : 0;
+}
+
+static
+int topk_rss(const sample_t *s, int last, uint64_t *value)
+{
+	*value = s->limit[LIMIT_RSS].cur;
+	return *value == SAMPLE_UNKNOWN ? -1 : 0;
+}
+
+static
+int topk_recvb(const sample_t *s, int last, uint64_t *value)
+{
+	if (last == -1)
+		return -1;
+
+	return topk_rate(s->cacct[CACCT_INET].recvb, GUESTS.inet_recvb[last],
+	                 s->cacct_time, GUESTS.cacct_time[last], value);
+}
+
+static
+int topk_sendb(const sample_t *s, int last, uint64_t *value)
+{
+	if (last == -1)
+		return -1;
+
+	return topk_rate(s->cacct[CACCT_INET].sendb, GUESTS.inet_sendb[last],
+	                 s->cacct_time, GUESTS.cacct_time[last], value);
+}
+
+static
+struct topk_data {
+	char *metric;
+	int (*value)(const sample_t *s, int last, uint64_t *value);
+	topk_entry_t *heap;
+	int len;
+} TOPK[] = {
+	{ "sys_LOADAVG:1MIN",     topk_load1,   NULL, 0 },
+	{ "thread_RUNNING:value", topk_running, NULL, 0 },
+	{ "mem_RSS:cur",          topk_rss,     NULL, 0 },
+	{ "net_INET:recvb/s",     topk_recvb,   NULL, 0 },
+	{ "net_INET:sendb/s",     topk_sendb,   NULL, 0 },
+	{ NULL,                   NULL,         NULL, 0 }
+};
+
+/* number of guests kept per metric, 0 if disabled */
+static int K = 0;
+
+int topk_init(void)
+{
+	LOG_TRACEME
+
+	const char *topkfile = cfg_getstr(cfg, "topkfile");
+	int i;
+
+	/* called again on reload */
+	for (i = 0; TOPK[i].metric; i++) {
+		mem_free(TOPK[i].heap);
+		TOPK[i].heap = NULL;
+	}
+
+	K = 0;
+
+	if (str_isempty(topkfile))
+		return 0;
+
+	K = cfg_getint(cfg, "topk");
+
+	if (K < 1) {
+		K = 0;
+		return 0;
+	}
+
+	for (i = 0; TOPK[i].metric; i++) {
+		TOPK[i].heap = mem_alloc(K * sizeof(topk_entry_t));
+
+		if (!TOPK[i].heap) {
+			K = 0;
+			return -1;
+		}
+
+		TOPK[i].len = 0;
+	}
+
+	return 0;
+}
+
+void topk_reset(void)
+{
+	LOG_TRACEME
+
+	int i;
+
+	for (i = 0; K > 0 && TOPK[i].metric; i++)
+		TOPK[i].len = 0;
+}
+
+static
+void topk_swap(topk_entry_t *a, topk_entry_t *b)
+{
+	topk_entry_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+/* the heap is a min-heap, so the root is the smallest value still in the
+ * top-K and every sample has to beat only that one to get in */
+static
+void topk_push(struct topk_data *t, uint64_t value, const char *name)
+{
+	topk_entry_t *heap = t->heap;
+	int i, child;
+
+	if (t->len < K) {
+		i = t->len++;
+
+		heap[i].value = value;
+		snprintf(heap[i].name, SAMPLE_NAMELEN, "%s", name);
+
+		while (i > 0 && heap[(i - 1) / 2].value > heap[i].value) {
+			topk_swap(&heap[(i - 1) / 2], &heap[i]);
+			i = (i - 1) / 2;
+		}
+
+		return;
+	}
+
+	if (value <= heap[0].value)
+		return;
+
+	heap[0].value = value;
+	snprintf(heap[0].name, SAMPLE_NAMELEN, "%s", name);
+
+	for (i = 0; (child = 2 * i + 1) < t->len; i = child) {
+		if (child + 1 < t->len && heap[child + 1].value < heap[child].value)
+			child++;
+
+		if (heap[i].value <= heap[child].value)
+			break;
+
+		topk_swap(&heap[i], &heap[child]);
+	}
+}
+
+/* last is the slot of the guest if it has a previous sample, -1 if not */
+void topk_add(const sample_t *s, int last)
+{
+	LOG_TRACEME
+
+	int i;
+	uint64_t value;
+
+	for (i = 0; K > 0 && TOPK[i].metric; i++)
+		if (TOPK[i].value(s, last, &value) == 0)
+			topk_push(&TOPK[i], value, s->name);
+}
+
+static
+int topk_cmp(const void *a, const void *b)
+{
+	const topk_entry_t *x = a, *y = b;
+
+	if (x->value == y->value)
+		return 0;
+
+	return x->value < y->value ? 1 : -1;
+}
+
+int topk_write(time_t curtime)
+{
+	LOG_TRACEME
+
+	if (K == 0)
+		return 0;
+
+	const char *topkfile = cfg_getstr(cfg, "topkfile");
+	char *tmpfile = NULL;
+	int fd, i, j;
+
+	asprintf(&tmpfile, "%s.tmp", topkfile);
+
+	if ((fd = open_trunc(tmpfile)) == -1) {
+		log_perror("open_trunc(%s)", tmpfile);
+		mem_free(tmpfile);
+		return -1;
+	}
+
+	dprintf(fd, "# %ld\n", curtime);
+
+	for (i = 0; TOPK[i].metric; i++) {
+		/* the heap is rebuilt next cycle, so sort it in place */
+		qsort(TOPK[i].heap, TOPK[i].len, sizeof(topk_entry_t), topk_cmp);
+
+		for (j = 0; j < TOPK[i].len; j++)
+			dprintf(fd, "%s %d %s %" PRIu64 "\n",
+			        TOPK[i].metric, j + 1,
+			        TOPK[i].heap[j].name, TOPK[i].heap[j].value);
+	}
+
+	close(fd);
+
+	if (rename(tmpfile, topkfile) == -1) {
+		log_perror("rename(%s)", topkfile);
+		mem_free(tmpfile);
+		return -1;
+	}
+
+	mem_free(tmpfile);
+	return 0;
+}
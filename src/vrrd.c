@@ -0,0 +1,122 @@
+// Copyright 2026 agent <agent@local>
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <rrd.h>
+
+#include "vrrd.h"
+
+#include <lucid/mem.h>
+#include <lucid/strtok.h>
+
+/* formatting only, used to benchmark everything but librrd */
+int vrrd_dryrun = 0;
+
+time_t vrrd_replay = 0;
+
+/* run an "update <file> <values>" command line and free it */
+int vrrd_update(char *name, char *buf)
+{
+	LOG_TRACEME
+
+	strtok_t _st, *st = &_st;
+	int rc = 0;
+
+	if (!strtok_init_str(st, buf, " ", 0)) {
+		mem_free(buf);
+		return -1;
+	}
+
+	mem_free(buf);
+
+	int argc    = strtok_count(st);
+	char **argv = mem_alloc((argc + 1) * sizeof(char *));
+
+	if (!argv) {
+		strtok_free(st);
+		return -1;
+	}
+
+	if (strtok_toargv(st, argv) < 1) {
+		mem_free(argv);
+		strtok_free(st);
+		return -1;
+	}
+
+	/* a replayed sample may have been persisted before, which librrd
+	 * would reject as an update into the past */
+	if (vrrd_replay && argc > 2) {
+		time_t last = rrd_last_r(argv[1]);
+
+		if (last != -1 && strtol(argv[2], NULL, 10) <= last) {
+			mem_free(argv);
+			strtok_free(st);
+			return 0;
+		}
+
+		rrd_clear_error();
+	}
+
+	if (!vrrd_dryrun && rrd_update(argc, argv) == -1) {
+		log_error("rrd_update(%s): %s", name, rrd_get_error());
+		rrd_clear_error();
+		rc = -1;
+	}
+
+	mem_free(argv);
+	strtok_free(st);
+
+	return rc;
+}
+
+static
+struct vrrd_family {
+	size_t time; /* offset of the family's timestamp in sample_t */
+	int (*check) (sample_t *s);
+	int (*update)(sample_t *s);
+} FAMILIES[] = {
+	{ offsetof(sample_t, cacct_time),   cacct_rrd_check,   cacct_rrd_update },
+	{ offsetof(sample_t, cvirt_time),   cvirt_rrd_check,   cvirt_rrd_update },
+	{ offsetof(sample_t, limit_time),   limit_rrd_check,   limit_rrd_update },
+	{ offsetof(sample_t, loadavg_time), loadavg_rrd_check, loadavg_rrd_update },
+	{ offsetof(sample_t, sched_time),   sched_rrd_check,   sched_rrd_update },
+	{ offsetof(sample_t, dlimit_time),  dlimit_rrd_check,  dlimit_rrd_update },
+	{ offsetof(sample_t, cgroup_time),  cgroup_rrd_check,  cgroup_rrd_update },
+	{ offsetof(sample_t, burst_time),   burst_rrd_check,   burst_rrd_update },
+	{ 0, NULL, NULL }
+};
+
+/* families a backend does not collect have no timestamp; a family that
+ * fails does not keep the others of the same sample from being written */
+int vrrd_store(sample_t *s)
+{
+	LOG_TRACEME
+
+	int i, rc = 0;
+
+	for (i = 0; FAMILIES[i].check; i++) {
+		time_t *t = (time_t *) ((char *) s + FAMILIES[i].time);
+
+		if (!*t)
+			continue;
+
+		if (FAMILIES[i].check(s) == -1 || FAMILIES[i].update(s) == -1)
+			rc = -1;
+	}
+
+	return rc;
+}
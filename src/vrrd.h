@@ -23,6 +23,8 @@
 
 #include <lucid/log.h>
 
+#include "sample.h"
+
 #define RRA_30M \
 	"RRA:AVERAGE:0:" STEPS30M ":" ROWS,
 
@@ -48,6 +50,17 @@
 
 #define RRA_DEFAULT  RRA_30M RRA_6H RRA_1D RRA_30D RRA_1Y
 
+/* time of the oldest sample while journaled or recorded samples are
+ * stored, 0 otherwise */
+extern time_t vrrd_replay;
+
+/* files created during a replay have to start before its oldest sample */
+static inline
+time_t vrrd_begin(void)
+{
+	return vrrd_replay ? vrrd_replay : time(NULL);
+}
+
 static inline
 time_t vrrd_align_time(time_t curtime)
 {
@@ -61,20 +74,41 @@ time_t vrrd_align_time(time_t curtime)
 		return (curtime - rest);
 }
 
-int cacct_fetch     (xid_t xid, time_t *curtime);
-int cacct_rrd_check (char *name);
-int cacct_rrd_update(char *name, time_t curtime);
+int cacct_fetch     (xid_t xid, sample_t *s);
+int cacct_rrd_check (sample_t *s);
+int cacct_rrd_update(sample_t *s);
+
+int cvirt_fetch     (xid_t xid, sample_t *s);
+int cvirt_rrd_check (sample_t *s);
+int cvirt_rrd_update(sample_t *s);
+
+int limit_fetch     (xid_t xid, sample_t *s);
+int limit_rrd_check (sample_t *s);
+int limit_rrd_update(sample_t *s);
+void limit_hard     (int g, sample_t *s);
+
+int loadavg_fetch     (xid_t xid, sample_t *s);
+int loadavg_rrd_check (sample_t *s);
+int loadavg_rrd_update(sample_t *s);
+
+int dlimit_fetch     (xid_t xid, sample_t *s);
+int dlimit_rrd_check (sample_t *s);
+int dlimit_rrd_update(sample_t *s);
+
+int sched_parse     (sample_t *s, char *buf);
+int sched_fetch     (xid_t xid, sample_t *s);
+int sched_rrd_check (sample_t *s);
+int sched_rrd_update(sample_t *s);
+
+int cgroup_rrd_check (sample_t *s);
+int cgroup_rrd_update(sample_t *s);
 
-int cvirt_fetch     (xid_t xid, time_t *curtime);
-int cvirt_rrd_check (char *name);
-int cvirt_rrd_update(char *name, time_t curtime);
+int burst_rrd_check (sample_t *s);
+int burst_rrd_update(sample_t *s);
 
-int limit_fetch     (xid_t xid, time_t *curtime);
-int limit_rrd_check (char *name);
-int limit_rrd_update(char *name, time_t curtime);
+extern int vrrd_dryrun;
 
-int loadavg_fetch     (xid_t xid, time_t *curtime);
-int loadavg_rrd_check (char *name);
-int loadavg_rrd_update(char *name, time_t curtime);
+int vrrd_update(char *name, char *buf);
+int vrrd_store (sample_t *s);
 
 #endif